@@ -1,8 +1,13 @@
 
 #include "DEBUG_PRINT.h"
 
-static int G_DEBUG_PRINT_LEVEL  = 1;
-static int G_DEBUG_PRINT_RETVAL = 0;
+#include <stdarg.h>
+
+#define DEBUG_PRINT_LINE_SIZE   (512)
+
+/* per thread, so that subsystems may be initialized concurrently */
+static __thread int G_DEBUG_PRINT_LEVEL  = 1;
+static __thread int G_DEBUG_PRINT_RETVAL = 0;
 
 void DEBUG_PRINT_LEVEL_ENTER( void )
 {
@@ -20,6 +25,41 @@ void DEBUG_PRINT_LEVEL( FILE * fptr, char * message )
     fflush(fptr);
 }
 
+void DEBUG_PRINT_LEVEL_FORMAT( FILE * fptr, const char * format, ... )
+{
+    char    line[DEBUG_PRINT_LINE_SIZE];
+    int     length;
+    va_list args;
+
+    length = snprintf(line, sizeof(line), "%*c", G_DEBUG_PRINT_LEVEL, ' ');
+
+    va_start(args, format);
+    vsnprintf(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+
+    fputs(line, fptr);
+    fflush(fptr);
+}
+
+void _DEBUG_PRINT_RESULT(   FILE *          fptr,
+                            const char *    message,
+                            int             behavior,
+                            const char *    file,
+                            int             line,
+                            const char *    function    )
+{
+    if (0 == G_DEBUG_PRINT_RETVAL)
+        DEBUG_PRINT_LEVEL_FORMAT(fptr, "%ssuccess.\n", message);
+    else
+        DEBUG_PRINT_LEVEL_FORMAT(fptr, "%s%s: %s(%d) in %s: process returned %d.\n",
+                                 message,
+                                 (FAILURE_FORBIDDEN != behavior) ? "warning" : "error",
+                                 file,
+                                 line,
+                                 function,
+                                 G_DEBUG_PRINT_RETVAL );
+}
+
 void _RV_SET( int val )
 {
     G_DEBUG_PRINT_RETVAL = val;
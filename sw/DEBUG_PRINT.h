@@ -13,27 +13,33 @@ extern FILE * G_SYSTEM_LOG;
 int     _RV_GET( void   );
 void    _RV_SET( int val);
 
+/* the line, with its result, is written with a single call, so lines from
+   threads initializing concurrently do not interleave */
 #define DEBUG_PRINT(FPTR, MESSAGE, RETVAL, BEHAVIOR)                \
     _RV_SET((RETVAL));                                              \
-    DEBUG_PRINT_LEVEL((FPTR), (MESSAGE));                           \
-    fprintf(                                                        \
-            (FPTR),                                                 \
-            (0 == _RV_GET())                                        \
-                ? "success.\n"                                      \
-                : "%s: %s(%d) in %s: process returned %d.\n",       \
-            ((BEHAVIOR) != FAILURE_FORBIDDEN)   ? "warning"         \
-                                                : "error",          \
-            __FILE__,                                               \
-            __LINE__,                                               \
-            __PRETTY_FUNCTION__,                                    \
-            _RV_GET()                                               \
-           );                                                       \
-    fflush((FPTR));                                                 \
+    _DEBUG_PRINT_RESULT(    (FPTR),                                 \
+                            (MESSAGE),                              \
+                            (BEHAVIOR),                             \
+                            __FILE__,                               \
+                            __LINE__,                               \
+                            __PRETTY_FUNCTION__                     \
+                       );                                           \
     if (0 != _RV_GET()) assert(FAILURE_FORBIDDEN != (BEHAVIOR))
 
+void    _DEBUG_PRINT_RESULT(    FILE *          fptr,
+                                const char *    message,
+                                int             behavior,
+                                const char *    file,
+                                int             line,
+                                const char *    function    );
+
 void DEBUG_PRINT_LEVEL_ENTER( void );
 void DEBUG_PRINT_LEVEL_EXIT( void );
 void DEBUG_PRINT_LEVEL( FILE * fptr, char * message );
 
+/* indents and prints a formatted line with a single call */
+void DEBUG_PRINT_LEVEL_FORMAT( FILE * fptr, const char * format, ... )
+    __attribute__((format(printf, 2, 3)));
+
 #endif /* DEBUG_PRINT_H */
 
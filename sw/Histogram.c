@@ -0,0 +1,175 @@
+
+/*
+File:   Histogram.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements the histogram declared in Histogram.h.
+
+With S = 2^HISTOGRAM_SUB_BITS, a value v < S is counted in bucket v.  A
+larger value with its top set bit at position msb is shifted right by
+shift = msb - HISTOGRAM_SUB_BITS + 1, which leaves a sub-bucket in
+[S/2, S); its bucket is shift * S/2 + sub-bucket.  Consecutive ranges of
+buckets therefore cover [0, S), [S, 2S), [2S, 4S), ... with no gaps.
+*/
+
+#include "Histogram.h"
+#include "DEBUG_PRINT.h"
+
+#define HISTOGRAM_SUB_COUNT     (1U << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_HALF_COUNT    (HISTOGRAM_SUB_COUNT / 2)
+#define HISTOGRAM_VALUE_MAX     ((1ULL << HISTOGRAM_MAX_BITS) - 1)
+
+static unsigned int Histogram_index( uint64_t value )
+{
+    unsigned int shift;
+
+    if (value > HISTOGRAM_VALUE_MAX) value = HISTOGRAM_VALUE_MAX;
+    if (value < HISTOGRAM_SUB_COUNT) return ((unsigned int) value);
+
+    shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS + 1;
+
+    return (shift * HISTOGRAM_HALF_COUNT + (unsigned int) (value >> shift));
+}
+
+/* largest value counted in bucket index */
+static uint64_t Histogram_highest( unsigned int index )
+{
+    unsigned int shift;
+
+    if (index < HISTOGRAM_SUB_COUNT) return (index);
+
+    shift = index / HISTOGRAM_HALF_COUNT - 1;
+
+    return ((((uint64_t) (index - shift * HISTOGRAM_HALF_COUNT) + 1) << shift) - 1);
+}
+
+void Histogram_init( struct HISTOGRAM * histogram )
+{
+    memset(histogram, 0, sizeof(struct HISTOGRAM));
+    histogram->min = UINT64_MAX;
+}
+
+void Histogram_record( struct HISTOGRAM * histogram, uint64_t value )
+{
+    histogram->buckets[Histogram_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+void Histogram_add( struct HISTOGRAM * dst, const struct HISTOGRAM * src )
+{
+    unsigned int i;
+
+    if (0 == src->count) return;
+
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+
+    dst->count += src->count;
+    dst->sum   += src->sum;
+
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t Histogram_percentile( const struct HISTOGRAM * histogram, double percentile )
+{
+    uint64_t target;
+    uint64_t seen = 0;
+    uint64_t value;
+    unsigned int i;
+
+    if (0 == histogram->count) return (0);
+
+    if (percentile < 0.0)   percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+
+    target = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+    if (target < 1) target = 1;
+
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= target) break;
+    }
+
+    /* the exact extremes are known; never report beyond them */
+    value = Histogram_highest(i);
+    if (value > histogram->max) value = histogram->max;
+    if (value < histogram->min) value = histogram->min;
+
+    return (value);
+}
+
+double Histogram_mean( const struct HISTOGRAM * histogram )
+{
+    return ((histogram->count > 0)  ? ((double) histogram->sum / histogram->count)
+                                    : 0.0);
+}
+
+void Histogram_windowInit( struct HISTOGRAM_WINDOW * window, uint64_t samplesPerSlot )
+{
+    unsigned int i;
+
+    for (i = 0; i < HISTOGRAM_WINDOW_SLOTS; i++)
+        Histogram_init(&window->slots[i]);
+
+    window->newest          = 0;
+    window->samplesPerSlot  = (samplesPerSlot > 0) ? samplesPerSlot : 1;
+}
+
+void Histogram_windowRecord( struct HISTOGRAM_WINDOW * window, uint64_t value )
+{
+    if (window->slots[window->newest].count >= window->samplesPerSlot)
+    {
+        window->newest = (window->newest + 1) % HISTOGRAM_WINDOW_SLOTS;
+        Histogram_init(&window->slots[window->newest]);
+    }
+
+    Histogram_record(&window->slots[window->newest], value);
+}
+
+void Histogram_windowGet(   const struct HISTOGRAM_WINDOW * window,
+                            struct HISTOGRAM *              histogram   )
+{
+    unsigned int i;
+
+    Histogram_init(histogram);
+
+    for (i = 0; i < HISTOGRAM_WINDOW_SLOTS; i++)
+        Histogram_add(histogram, &window->slots[i]);
+}
+
+void Histogram_print(   const struct HISTOGRAM *    histogram,
+                        FILE *                      fptr,
+                        const char *                label,
+                        double                      scale,
+                        const char *                unit    )
+{
+    DEBUG_PRINT_LEVEL(fptr, "");
+
+    if (0 == histogram->count)
+    {
+        fprintf(fptr, "%-24s n=0\n", label);
+        return;
+    }
+
+    fprintf(fptr,   "%-24s n=%-6llu min %8.3f  mean %8.3f  p50 %8.3f  p90 %8.3f  "
+                    "p99 %8.3f  p99.9 %8.3f  max %8.3f%s%s\n",
+                    label,
+                    (unsigned long long) histogram->count,
+                    histogram->min / scale,
+                    Histogram_mean(histogram) / scale,
+                    Histogram_percentile(histogram, 50.0) / scale,
+                    Histogram_percentile(histogram, 90.0) / scale,
+                    Histogram_percentile(histogram, 99.0) / scale,
+                    Histogram_percentile(histogram, 99.9) / scale,
+                    histogram->max / scale,
+                    ('\0' != unit[0]) ? " " : "",
+                    unit );
+}
@@ -0,0 +1,92 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/*
+File:   Histogram.h
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file declares a fixed-size, HDR-style histogram of unsigned 64-bit
+values (typically latencies in nanoseconds).
+
+Values below 2^HISTOGRAM_SUB_BITS are counted exactly.  Above that, each
+power-of-two range is split into 2^(HISTOGRAM_SUB_BITS - 1) equal buckets,
+so every value is recorded with a relative error of at most
+2^-(HISTOGRAM_SUB_BITS - 1) (about 6%) regardless of its magnitude.
+Values of 2^HISTOGRAM_MAX_BITS or more (about 18 minutes in nanoseconds)
+are counted in the last bucket.
+
+Recording is a handful of integer operations and never allocates, so it is
+cheap enough to do on every Modbus transaction.  A histogram does no
+locking of its own.
+
+A HISTOGRAM_WINDOW keeps rolling statistics over roughly the last
+HISTOGRAM_WINDOW_SLOTS * samplesPerSlot values: values go into the newest
+of HISTOGRAM_WINDOW_SLOTS histograms, and once it holds samplesPerSlot
+values the oldest is cleared and becomes the newest.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BITS      5
+#define HISTOGRAM_MAX_BITS      40
+#define HISTOGRAM_N_BUCKETS     ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) \
+                                    << (HISTOGRAM_SUB_BITS - 1))
+
+#define HISTOGRAM_WINDOW_SLOTS  4
+
+struct HISTOGRAM
+{
+    uint64_t    count;
+    uint64_t    min;
+    uint64_t    max;
+    uint64_t    sum;
+    uint64_t    buckets[HISTOGRAM_N_BUCKETS];
+};
+
+struct HISTOGRAM_WINDOW
+{
+    struct HISTOGRAM    slots[HISTOGRAM_WINDOW_SLOTS];
+    unsigned int        newest;
+    uint64_t            samplesPerSlot;
+};
+
+void        Histogram_init      ( struct HISTOGRAM * histogram );
+void        Histogram_record    ( struct HISTOGRAM * histogram, uint64_t value );
+
+/* add every value recorded in src to dst */
+void        Histogram_add       (   struct HISTOGRAM *          dst,
+                                    const struct HISTOGRAM *    src );
+
+/*  Histogram_percentile( histogram, percentile )
+ *  Returns the smallest value v such that at least percentile% of the
+ *  recorded values are <= v, to within the bucket resolution, or 0 if the
+ *  histogram is empty.
+ */
+uint64_t    Histogram_percentile(   const struct HISTOGRAM *    histogram,
+                                    double                      percentile  );
+double      Histogram_mean      ( const struct HISTOGRAM * histogram );
+
+void        Histogram_windowInit    (   struct HISTOGRAM_WINDOW *   window,
+                                        uint64_t                    samplesPerSlot  );
+void        Histogram_windowRecord  (   struct HISTOGRAM_WINDOW *   window,
+                                        uint64_t                    value   );
+
+/* overwrite histogram with the union of the window's slots */
+void        Histogram_windowGet     (   const struct HISTOGRAM_WINDOW * window,
+                                        struct HISTOGRAM *              histogram   );
+
+/*  Histogram_print( histogram, fptr, label, scale, unit )
+ *  Prints one line: count, min, mean, p50, p90, p99, p99.9 and max, each
+ *  divided by scale (e.g. 1e6 and "ms" for a histogram of nanoseconds).
+ */
+void        Histogram_print     (   const struct HISTOGRAM *    histogram,
+                                    FILE *                      fptr,
+                                    const char *                label,
+                                    double                      scale,
+                                    const char *                unit    );
+
+#endif /* HISTOGRAM_H */
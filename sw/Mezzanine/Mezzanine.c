@@ -16,10 +16,77 @@ The Mezzanine_...SetState() functions accept values and the ...GetState()
 functions accept pointers to data they modify.  Note that the functions
 return error values, and you are responsible for checking that the
 operation was successful.
+
+Where the GPIO character device is available, the hotplate, conveyor and
+button pins are requested as line groups, so that e.g. a conveyor state
+change is a single ioctl().  Otherwise, the pins are exported and accessed
+one at a time through the gpio.h backend.
+
+Mezzanine_ButtonsArmEvents() replaces the polled button lines with edge
+events.  Edges are debounced and delivered, with their kernel timestamps,
+by Mezzanine_ButtonsReadEvent(); the descriptor returned when arming may
+be added to the caller's poll() set, so no polling is needed while idle.
+Debouncing waits for the line to settle and then samples its level, so a
+noise spike which returns to the previous level produces no event.
+
+Mezzanine_ConveyorRunFor() hands the stop to a timer thread, started on
+first use, so that the caller need not sleep while the conveyor runs.
+Output writes are serialized with g_outputLock for this reason.  If the
+stop fails, its deadline stays armed and the write is retried, backing off
+from CONVEYOR_STOP_RETRY_MS to CONVEYOR_STOP_RETRY_MAX_MS, until it
+succeeds or a new conveyor command replaces it.
+
+This process is the only writer of the hotplate and conveyor outputs, so
+their last commanded values are kept as shadow state.  GetState answers
+from the shadow, and SetState skips writes which would not change it.
+Mezzanine_VerifyOutputs() reads the pins back and reports divergence; it
+may be run periodically on the timer thread with Mezzanine_SetVerifyPeriod().
 */
 
 #include "Mezzanine.h"
 
+/* line groups; NULL if the pins are accessed through sysfs instead */
+static struct GPIO_GROUP * g_hotplate = NULL;   /* { HOTPLATE }         */
+static struct GPIO_GROUP * g_conveyor = NULL;   /* { FWD, REV }         */
+static struct GPIO_GROUP * g_buttons  = NULL;   /* { STOP, START }      */
+
+static const int g_hotplateLines[] = { GPIO_HOTPLATE                        };
+static const int g_conveyorLines[] = { GPIO_CONVEYOR_FWD, GPIO_CONVEYOR_REV };
+static const int g_buttonsLines[]  = { GPIO_STOP, GPIO_START                };
+static const int g_allLow[]        = { GPIO_LOW, GPIO_LOW                   };
+static const int g_buttonsPressed[]= { STOP_PRESSED, START_PRESSED          };
+
+/* shadow state: last commanded output values, -1 if unknown */
+static int              g_hotplateShadow    = -1;
+static int              g_conveyorShadow    = -1;
+static unsigned long    g_nDivergences      = 0;
+
+/* timer thread state; deadlines are CLOCK_MONOTONIC, 0 if none pending */
+static pthread_mutex_t  g_outputLock        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_timerCond;
+static pthread_t        g_timerThread;
+static int              g_timerRunning      = 0;
+static int              g_timerStop         = 0;
+static struct timespec  g_conveyorDeadline  = { 0, 0 };
+static unsigned int     g_conveyorRetryMs   = 0;    /* 0 unless a stop failed */
+static struct timespec  g_verifyDeadline    = { 0, 0 };
+static unsigned int     g_verifyPeriodMs    = 0;
+
+/* edge event state, indexed by BUTTON_STOP/BUTTON_START */
+static int      g_buttonsEpoll          = -1;
+static int      g_buttonsEventFd[2]     = { -1, -1 };
+static int      g_buttonsLevel[2];
+
+#define N_LINES(LINES) ((int) (sizeof(LINES) / sizeof((LINES)[0])))
+
+
+static void Mezzanine_shadowSet( int * shadow, int value )
+{
+    pthread_mutex_lock(&g_outputLock);
+    *shadow = value;
+    pthread_mutex_unlock(&g_outputLock);
+}
+
 
 int Mezzanine_HotplateInit( void )
 {
@@ -28,6 +95,25 @@ int Mezzanine_HotplateInit( void )
     DEBUG_PRINT_LEVEL(LOG_STREAM, "Initializing hotplate.\n");
     DEBUG_PRINT_LEVEL_ENTER();
 
+    GpioGroupRelease(g_hotplate);
+    g_hotplate = GpioGroupRequest(  g_hotplateLines,
+                                    N_LINES(g_hotplateLines),
+                                    GPIO_GROUP_OUTPUT,
+                                    g_allLow    );
+
+    DEBUG_PRINT (   LOG_STREAM,
+                    "Requesting line group...",
+                    NULL == g_hotplate,
+                    FAILURE_ALLOWED
+                );
+
+    if (NULL != g_hotplate)
+    {
+        Mezzanine_shadowSet(&g_hotplateShadow, HOTPLATE_OFF);
+        DEBUG_PRINT_LEVEL_EXIT();
+        return (warning);
+    }
+
     DEBUG_PRINT (   LOG_STREAM,
                     "Exporting pin...........",
                     warning = GpioExport(GPIO_HOTPLATE),
@@ -46,6 +132,8 @@ int Mezzanine_HotplateInit( void )
                     FAILURE_FORBIDDEN
                 );
 
+    Mezzanine_shadowSet(&g_hotplateShadow, HOTPLATE_OFF);
+
     DEBUG_PRINT_LEVEL_EXIT();
 
     return (warning);
@@ -58,6 +146,25 @@ int Mezzanine_ConveyorInit( void )
     DEBUG_PRINT_LEVEL(LOG_STREAM, "Initializing conveyor.\n");
     DEBUG_PRINT_LEVEL_ENTER();
 
+    GpioGroupRelease(g_conveyor);
+    g_conveyor = GpioGroupRequest(  g_conveyorLines,
+                                    N_LINES(g_conveyorLines),
+                                    GPIO_GROUP_OUTPUT,
+                                    g_allLow    );
+
+    DEBUG_PRINT (   LOG_STREAM,
+                    "Requesting line group.......",
+                    NULL == g_conveyor,
+                    FAILURE_ALLOWED
+                );
+
+    if (NULL != g_conveyor)
+    {
+        Mezzanine_shadowSet(&g_conveyorShadow, CONVEYOR_STOPPED);
+        DEBUG_PRINT_LEVEL_EXIT();
+        return (warning);
+    }
+
     DEBUG_PRINT (   LOG_STREAM,
                     "Exporting FWD pin...........",
                     warning = GpioExport(GPIO_CONVEYOR_FWD),
@@ -94,6 +201,8 @@ int Mezzanine_ConveyorInit( void )
                     FAILURE_FORBIDDEN
                 );
 
+    Mezzanine_shadowSet(&g_conveyorShadow, CONVEYOR_STOPPED);
+
     DEBUG_PRINT_LEVEL_EXIT();
 
     return (warning);
@@ -108,39 +217,54 @@ int Mezzanine_ButtonsInit( void )
     DEBUG_PRINT_LEVEL(LOG_STREAM, "Initializing buttons.\n");
     DEBUG_PRINT_LEVEL_ENTER();
 
-    DEBUG_PRINT (   LOG_STREAM,
-                    "Exporting STOP pin...........",
-                    warning = GpioExport(GPIO_STOP),
-                    FAILURE_ALLOWED
-                );
+    GpioGroupRelease(g_buttons);
+    g_buttons = GpioGroupRequest(   g_buttonsLines,
+                                    N_LINES(g_buttonsLines),
+                                    GPIO_GROUP_INPUT,
+                                    NULL    );
 
     DEBUG_PRINT (   LOG_STREAM,
-                    "Exporting START pin..........",
-                    warning = GpioExport(GPIO_START),
+                    "Requesting line group.........",
+                    NULL == g_buttons,
                     FAILURE_ALLOWED
                 );
 
-    DEBUG_PRINT (   LOG_STREAM,
-                    "Setting STOP pin direction...",
-                    GpioSetDirection(GPIO_STOP, GPIO_INPUT),
-                    FAILURE_FORBIDDEN
-                );
-
-    DEBUG_PRINT (   LOG_STREAM,
-                    "Setting START pin direction...",
-                    GpioSetDirection(GPIO_START, GPIO_INPUT),
-                    FAILURE_FORBIDDEN
-                );
+    if (NULL == g_buttons)
+    {
+        DEBUG_PRINT (   LOG_STREAM,
+                        "Exporting STOP pin...........",
+                        warning = GpioExport(GPIO_STOP),
+                        FAILURE_ALLOWED
+                    );
+
+        DEBUG_PRINT (   LOG_STREAM,
+                        "Exporting START pin..........",
+                        warning = GpioExport(GPIO_START),
+                        FAILURE_ALLOWED
+                    );
+
+        DEBUG_PRINT (   LOG_STREAM,
+                        "Setting STOP pin direction...",
+                        GpioSetDirection(GPIO_STOP, GPIO_INPUT),
+                        FAILURE_FORBIDDEN
+                    );
+
+        DEBUG_PRINT (   LOG_STREAM,
+                        "Setting START pin direction...",
+                        GpioSetDirection(GPIO_START, GPIO_INPUT),
+                        FAILURE_FORBIDDEN
+                    );
+    }
 
     DEBUG_PRINT (   LOG_STREAM,
                     "Getting STOP pin value.......",
-                    GpioGetValue(GPIO_STOP, &stopValue),
+                    Mezzanine_StopButtonGetState(&stopValue),
                     FAILURE_FORBIDDEN
                 );
 
     DEBUG_PRINT (   LOG_STREAM,
                     "Getting START pin value......",
-                    GpioGetValue(GPIO_START, &startValue),
+                    Mezzanine_StartButtonGetState(&startValue),
                     FAILURE_FORBIDDEN
                 );
 
@@ -184,62 +308,655 @@ int Mezzanine_TempSensorInit( void )
 }
 
 
-int Mezzanine_HotplateGetState( int * state )
+/* must hold g_outputLock */
+static int Mezzanine_hotplateRead( int * state )
 {
+    if (NULL != g_hotplate)
+        return (GpioGroupGetValues(g_hotplate, state));
+
     return (GpioGetValue(GPIO_HOTPLATE, state));
 }
 
-int Mezzanine_HotplateSetState( int state )
+/* must hold g_outputLock */
+static int Mezzanine_hotplateWrite( int state )
 {
-    return (GpioSetValue(GPIO_HOTPLATE, state));
+    int result;
+
+    state = state ? HOTPLATE_ON : HOTPLATE_OFF;
+    if (state == g_hotplateShadow) return (0);
+
+    if (NULL != g_hotplate)
+        result = GpioGroupSetValues(g_hotplate, &state);
+    else
+        result = GpioSetValue(GPIO_HOTPLATE, state);
+
+    g_hotplateShadow = (0 == result) ? state : -1;
+
+    return (result);
 }
 
-int Mezzanine_ConveyorGetState( int * state )
+/* must hold g_outputLock */
+static int Mezzanine_conveyorRead( int * state )
 {
-    int forward = 0;
-    int reverse = 0;
-    int result  = 0;
-    
-    result |= GpioGetValue(GPIO_CONVEYOR_FWD, &forward);
-    result |= GpioGetValue(GPIO_CONVEYOR_FWD, &reverse);
-    
-    *state = forward + 2 * reverse;
-    
+    int lines[2]    = { 0, 0 };     /* { forward, reverse } */
+    int result      = 0;
+
+    if (NULL != g_conveyor)
+    {
+        result = GpioGroupGetValues(g_conveyor, lines);
+    }
+    else
+    {
+        result |= GpioGetValue(GPIO_CONVEYOR_FWD, &lines[0]);
+        result |= GpioGetValue(GPIO_CONVEYOR_REV, &lines[1]);
+    }
+
+    *state = lines[0] + 2 * lines[1];
+
     return (result);
 }
 
-int Mezzanine_ConveyorSetState( int state )
+/* must hold g_outputLock */
+static int Mezzanine_conveyorWrite( int state )
 {
+    int lines[2];   /* { forward, reverse } */
     int result = 0;
+
     switch (state)
     {
         case CONVEYOR_FORWARD:
-            result |= GpioSetValue(GPIO_CONVEYOR_REV, GPIO_LOW);
-            result |= GpioSetValue(GPIO_CONVEYOR_FWD, GPIO_HIGH);
+            lines[0] = GPIO_HIGH;
+            lines[1] = GPIO_LOW;
             break;
 
         case CONVEYOR_REVERSE:
-            result |= GpioSetValue(GPIO_CONVEYOR_FWD, GPIO_LOW);
-            result |= GpioSetValue(GPIO_CONVEYOR_REV, GPIO_HIGH);
+            lines[0] = GPIO_LOW;
+            lines[1] = GPIO_HIGH;
             break;
 
         case CONVEYOR_STOPPED:  /* fall through */
         default:
-            result |= GpioSetValue(GPIO_CONVEYOR_FWD, GPIO_LOW);
-            result |= GpioSetValue(GPIO_CONVEYOR_REV, GPIO_LOW);
+            state    = CONVEYOR_STOPPED;
+            lines[0] = GPIO_LOW;
+            lines[1] = GPIO_LOW;
+    }
+
+    if (state == g_conveyorShadow) return (0);
+
+    if (NULL != g_conveyor)
+    {
+        result = GpioGroupSetValues(g_conveyor, lines);
+    }
+    else if (GPIO_LOW == lines[0])
+    {
+        /* one at a time: always drive the inactive direction low first */
+        result |= GpioSetValue(GPIO_CONVEYOR_FWD, lines[0]);
+        result |= GpioSetValue(GPIO_CONVEYOR_REV, lines[1]);
+    }
+    else
+    {
+        result |= GpioSetValue(GPIO_CONVEYOR_REV, lines[1]);
+        result |= GpioSetValue(GPIO_CONVEYOR_FWD, lines[0]);
+    }
+
+    g_conveyorShadow = (0 == result) ? state : -1;
+
+    return (result);
+}
+
+/* must hold g_outputLock */
+static int Mezzanine_verifyOutputs( void )
+{
+    int actual;
+    int nDiverged = 0;
+
+    if ((-1 != g_hotplateShadow) &&
+        (0 == Mezzanine_hotplateRead(&actual)) &&
+        (actual != g_hotplateShadow))
+    {
+        DEBUG_PRINT_LEVEL(LOG_STREAM, "");
+        fprintf(LOG_STREAM, "Mezzanine: hotplate reads %d, commanded %d.\n",
+                actual, g_hotplateShadow);
+        g_hotplateShadow = -1;
+        nDiverged++;
+    }
+
+    if ((-1 != g_conveyorShadow) &&
+        (0 == Mezzanine_conveyorRead(&actual)) &&
+        (actual != g_conveyorShadow))
+    {
+        DEBUG_PRINT_LEVEL(LOG_STREAM, "");
+        fprintf(LOG_STREAM, "Mezzanine: conveyor reads %d, commanded %d.\n",
+                actual, g_conveyorShadow);
+        g_conveyorShadow = -1;
+        nDiverged++;
+    }
+
+    g_nDivergences += nDiverged;
+
+    return (nDiverged);
+}
+
+int Mezzanine_HotplateGetState( int * state )
+{
+    int result = 0;
+
+    pthread_mutex_lock(&g_outputLock);
+
+    if (-1 != g_hotplateShadow)
+        *state = g_hotplateShadow;
+    else
+        result = Mezzanine_hotplateRead(state);
+
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (result);
+}
+
+int Mezzanine_HotplateSetState( int state )
+{
+    int result;
+
+    pthread_mutex_lock(&g_outputLock);
+    result = Mezzanine_hotplateWrite(state);
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (result);
+}
+
+int Mezzanine_ConveyorGetState( int * state )
+{
+    int result = 0;
+
+    pthread_mutex_lock(&g_outputLock);
+
+    if (-1 != g_conveyorShadow)
+        *state = g_conveyorShadow;
+    else
+        result = Mezzanine_conveyorRead(state);
+
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (result);
+}
+
+static int Mezzanine_timespecBefore( const struct timespec * a,
+                                     const struct timespec * b  )
+{
+    return ((a->tv_sec < b->tv_sec) ||
+            ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec)));
+}
+
+static void Mezzanine_timespecAddMs( struct timespec * t, unsigned int ms )
+{
+    t->tv_sec  += ms / 1000;
+    t->tv_nsec += (ms % 1000) * 1000000L;
+    if (t->tv_nsec >= 1000000000L)
+    {
+        t->tv_nsec -= 1000000000L;
+        t->tv_sec++;
+    }
+}
+
+/* must hold g_outputLock; on failure, re-arms the deadline after a backoff */
+static void Mezzanine_timerStopConveyor( const struct timespec * now )
+{
+    int result;
+
+    result = Mezzanine_conveyorWrite(CONVEYOR_STOPPED);
+
+    if ((0 != result) || (0 != g_conveyorRetryMs))
+    {
+        DEBUG_PRINT(LOG_STREAM, "Mezzanine: stopping conveyor at its deadline...",
+                    result, FAILURE_ALLOWED);
+    }
+
+    if (0 == result)
+    {
+        g_conveyorDeadline.tv_sec = 0;
+        g_conveyorRetryMs = 0;
+        return;
+    }
+
+    g_conveyorRetryMs = (0 == g_conveyorRetryMs) ? CONVEYOR_STOP_RETRY_MS
+                                                 : 2 * g_conveyorRetryMs;
+    if (g_conveyorRetryMs > CONVEYOR_STOP_RETRY_MAX_MS)
+        g_conveyorRetryMs = CONVEYOR_STOP_RETRY_MAX_MS;
+
+    DEBUG_PRINT_LEVEL(LOG_STREAM, "");
+    fprintf(LOG_STREAM, "Mezzanine: retrying conveyor stop in %u ms.\n", g_conveyorRetryMs);
+    fflush(LOG_STREAM);
+
+    g_conveyorDeadline = *now;
+    Mezzanine_timespecAddMs(&g_conveyorDeadline, g_conveyorRetryMs);
+}
+
+static void * Mezzanine_timerThread( void * dontcare )
+{
+    struct timespec     now;
+    struct timespec *   next;
+
+    (void) dontcare;
+
+    pthread_mutex_lock(&g_outputLock);
+
+    while (!g_timerStop)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if ((0 != g_conveyorDeadline.tv_sec) &&
+            !Mezzanine_timespecBefore(&now, &g_conveyorDeadline))
+        {
+            Mezzanine_timerStopConveyor(&now);
+            continue;
+        }
+
+        if ((0 != g_verifyPeriodMs) &&
+            !Mezzanine_timespecBefore(&now, &g_verifyDeadline))
+        {
+            Mezzanine_verifyOutputs();
+            g_verifyDeadline = now;
+            Mezzanine_timespecAddMs(&g_verifyDeadline, g_verifyPeriodMs);
+            continue;
+        }
+
+        /* sleep until the earliest pending deadline */
+        next = NULL;
+        if (0 != g_conveyorDeadline.tv_sec)
+            next = &g_conveyorDeadline;
+        if ((0 != g_verifyPeriodMs) &&
+            ((NULL == next) || Mezzanine_timespecBefore(&g_verifyDeadline, next)))
+            next = &g_verifyDeadline;
+
+        if (NULL == next)
+            pthread_cond_wait(&g_timerCond, &g_outputLock);
+        else
+            pthread_cond_timedwait(&g_timerCond, &g_outputLock, next);
+    }
+
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (NULL);
+}
+
+/* must hold g_outputLock */
+static int Mezzanine_timerStart( void )
+{
+    pthread_condattr_t attributes;
+
+    if (g_timerRunning) return (0);
+
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_timerCond, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    g_timerStop = 0;
+    if (0 != pthread_create(&g_timerThread, NULL, Mezzanine_timerThread, NULL))
+    {
+        pthread_cond_destroy(&g_timerCond);
+        return (-1);
+    }
+
+    g_timerRunning = 1;
+
+    return (0);
+}
+
+int Mezzanine_ConveyorSetState( int state )
+{
+    int result;
+
+    pthread_mutex_lock(&g_outputLock);
+
+    /* an explicit state replaces any pending timed stop */
+    g_conveyorDeadline.tv_sec = 0;
+    g_conveyorRetryMs = 0;
+    result = Mezzanine_conveyorWrite(state);
+
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (result);
+}
+
+int Mezzanine_ConveyorRunFor( int state, unsigned int milliseconds )
+{
+    struct timespec deadline;
+    int result;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    Mezzanine_timespecAddMs(&deadline, milliseconds);
+
+    pthread_mutex_lock(&g_outputLock);
+
+    result = Mezzanine_timerStart();
+    if (0 == result)
+    {
+        result = Mezzanine_conveyorWrite(state);
+
+        if (0 == result)
+        {
+            g_conveyorDeadline = deadline;
+            g_conveyorRetryMs = 0;
+            pthread_cond_signal(&g_timerCond);
+        }
     }
-    
+
+    pthread_mutex_unlock(&g_outputLock);
+
     return (result);
 }
 
+int Mezzanine_VerifyOutputs( void )
+{
+    int nDiverged;
+
+    pthread_mutex_lock(&g_outputLock);
+    nDiverged = Mezzanine_verifyOutputs();
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (nDiverged);
+}
+
+int Mezzanine_SetVerifyPeriod( unsigned int milliseconds )
+{
+    int result = 0;
+
+    pthread_mutex_lock(&g_outputLock);
+
+    if (0 != milliseconds) result = Mezzanine_timerStart();
+
+    if (0 == result)
+    {
+        g_verifyPeriodMs = milliseconds;
+        clock_gettime(CLOCK_MONOTONIC, &g_verifyDeadline);
+        Mezzanine_timespecAddMs(&g_verifyDeadline, milliseconds);
+
+        if (g_timerRunning) pthread_cond_signal(&g_timerCond);
+    }
+
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (result);
+}
+
+unsigned long Mezzanine_GetDivergenceCount( void )
+{
+    unsigned long nDivergences;
+
+    pthread_mutex_lock(&g_outputLock);
+    nDivergences = g_nDivergences;
+    pthread_mutex_unlock(&g_outputLock);
+
+    return (nDivergences);
+}
+
 int Mezzanine_StopButtonGetState( int * state )
 {
-    return (GpioGetValue(GPIO_STOP, state));
+    int lines[2];   /* { stop, start } */
+    int result;
+
+    if (-1 != g_buttonsEventFd[BUTTON_STOP])
+        return (GpioEventGetValue(g_buttonsEventFd[BUTTON_STOP], state));
+
+    if (NULL == g_buttons)
+        return (GpioGetValue(GPIO_STOP, state));
+
+    result = GpioGroupGetValues(g_buttons, lines);
+    *state = lines[0];
+
+    return (result);
 }
 
 int Mezzanine_StartButtonGetState( int * state )
 {
-    return (GpioGetValue(GPIO_START, state));
+    int lines[2];   /* { stop, start } */
+    int result;
+
+    if (-1 != g_buttonsEventFd[BUTTON_START])
+        return (GpioEventGetValue(g_buttonsEventFd[BUTTON_START], state));
+
+    if (NULL == g_buttons)
+        return (GpioGetValue(GPIO_START, state));
+
+    result = GpioGroupGetValues(g_buttons, lines);
+    *state = lines[1];
+
+    return (result);
+}
+
+int Mezzanine_ButtonsGetState( int * stop, int * start )
+{
+    int lines[2];   /* { stop, start } */
+    int result = 0;
+
+    if (-1 != g_buttonsEpoll)
+    {
+        result |= GpioEventGetValue(g_buttonsEventFd[BUTTON_STOP],  &lines[0]);
+        result |= GpioEventGetValue(g_buttonsEventFd[BUTTON_START], &lines[1]);
+    }
+    else if (NULL != g_buttons)
+    {
+        result = GpioGroupGetValues(g_buttons, lines);
+    }
+    else
+    {
+        result |= GpioGetValue(GPIO_STOP,  &lines[0]);
+        result |= GpioGetValue(GPIO_START, &lines[1]);
+    }
+
+    *stop  = lines[0];
+    *start = lines[1];
+
+    return (result);
+}
+
+int Mezzanine_ButtonsArmEvents( void )
+{
+    struct epoll_event interest;
+    int i;
+
+    if (-1 != g_buttonsEpoll) return (g_buttonsEpoll);
+
+    /* event lines replace the polled group; both can't hold the lines */
+    GpioGroupRelease(g_buttons);
+    g_buttons = NULL;
+
+    g_buttonsEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == g_buttonsEpoll)
+    {
+        Mezzanine_ButtonsDisarmEvents();
+        return (-1);
+    }
+
+    for (i = BUTTON_STOP; i <= BUTTON_START; i++)
+    {
+        g_buttonsEventFd[i] = GpioEventRequest(g_buttonsLines[i], GPIO_EDGE_BOTH);
+        if (0 > g_buttonsEventFd[i]) break;
+
+        if (0 != GpioEventGetValue(g_buttonsEventFd[i], &g_buttonsLevel[i]))
+            break;
+
+        interest.events     = EPOLLIN;
+        interest.data.u32   = i;
+        if (0 != epoll_ctl(g_buttonsEpoll, EPOLL_CTL_ADD,
+                           g_buttonsEventFd[i], &interest)) break;
+    }
+
+    if (i <= BUTTON_START)
+    {
+        Mezzanine_ButtonsDisarmEvents();
+        return (-1);
+    }
+
+    return (g_buttonsEpoll);
+}
+
+void Mezzanine_ButtonsDisarmEvents( void )
+{
+    int i;
+
+    for (i = BUTTON_STOP; i <= BUTTON_START; i++)
+    {
+        if (0 <= g_buttonsEventFd[i]) close(g_buttonsEventFd[i]);
+        g_buttonsEventFd[i] = -1;
+    }
+
+    if (-1 != g_buttonsEpoll) close(g_buttonsEpoll);
+    g_buttonsEpoll = -1;
+
+    /* return to polling; falls back to sysfs if the group is unavailable */
+    if (NULL == g_buttons)
+        g_buttons = GpioGroupRequest(   g_buttonsLines,
+                                        N_LINES(g_buttonsLines),
+                                        GPIO_GROUP_INPUT,
+                                        NULL    );
+}
+
+int Mezzanine_ButtonsGetEventFd( void )
+{
+    return (g_buttonsEpoll);
+}
+
+static int64_t Mezzanine_nowMs( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+/* reads edges on a line until it has none for BUTTON_DEBOUNCE_NS, or for at
+   most BUTTON_SETTLE_MAX_NS in all, so a line that never stops chattering
+   is sampled anyway */
+static int Mezzanine_buttonsSettle( int i )
+{
+    struct pollfd   line;
+    uint64_t        timestamp;
+    int64_t         giveUpMs;
+    int64_t         remainingMs;
+    int             level;
+    int             nReady;
+
+    line.fd     = g_buttonsEventFd[i];
+    line.events = POLLIN;
+    giveUpMs    = Mezzanine_nowMs() + (int64_t) ((BUTTON_SETTLE_MAX_NS + 999999) / 1000000);
+
+    for (;;)
+    {
+        remainingMs = giveUpMs - Mezzanine_nowMs();
+        if (remainingMs <= 0) return (0);
+        if (remainingMs > (int64_t) ((BUTTON_DEBOUNCE_NS + 999999) / 1000000))
+            remainingMs = (int64_t) ((BUTTON_DEBOUNCE_NS + 999999) / 1000000);
+
+        nReady = poll(&line, 1, (int) remainingMs);
+        if ((-1 == nReady) && (EINTR == errno)) continue;
+        if (0 == nReady) return (0);
+        if (1 != nReady) return (-1);
+
+        if (0 != GpioEventRead(g_buttonsEventFd[i], &timestamp, &level))
+            return (-1);
+    }
+}
+
+int Mezzanine_ButtonsReadEvent( struct MEZZANINE_BUTTON_EVENT * event,
+                                int                             timeoutMs )
+{
+    struct epoll_event  ready;
+    uint64_t            timestamp;
+    int64_t             deadlineMs  = Mezzanine_nowMs() + timeoutMs;
+    int                 waitMs      = timeoutMs;
+    int                 level;
+    int                 nReady;
+    int                 i;
+
+    if (-1 == g_buttonsEpoll) return (-1);
+
+    for (;;)
+    {
+        nReady = epoll_wait(g_buttonsEpoll, &ready, 1, waitMs);
+        if ((-1 == nReady) && (EINTR == errno)) nReady = 0;
+        else if (1 != nReady) return (nReady);
+
+        if (1 == nReady)
+        {
+            /* the event's time is that of its first edge, not of the
+               bounce that followed */
+            i = ready.data.u32;
+            if (0 != GpioEventRead(g_buttonsEventFd[i], &timestamp, &level))
+                return (-1);
+
+            /* sample the level once the bounce has died down; a spike
+               which came back to the debounced level is dropped */
+            if (0 != Mezzanine_buttonsSettle(i)) return (-1);
+            if (0 != GpioEventGetValue(g_buttonsEventFd[i], &level)) return (-1);
+
+            if (level != g_buttonsLevel[i])
+            {
+                g_buttonsLevel[i] = level;
+
+                event->button       = i;
+                event->pressed      = (g_buttonsPressed[i] == level);
+                event->timestamp    = timestamp;
+
+                return (1);
+            }
+        }
+
+        /* wait again only for what is left of timeoutMs */
+        if (timeoutMs >= 0)
+        {
+            if (Mezzanine_nowMs() >= deadlineMs) return (0);
+            waitMs = (int) (deadlineMs - Mezzanine_nowMs());
+        }
+    }
+}
+
+void Mezzanine_Shdn( void )
+{
+    pthread_mutex_lock(&g_outputLock);
+
+    if (g_timerRunning)
+    {
+        g_timerStop = 1;
+        pthread_cond_signal(&g_timerCond);
+        pthread_mutex_unlock(&g_outputLock);
+
+        pthread_join(g_timerThread, NULL);
+
+        pthread_mutex_lock(&g_outputLock);
+        pthread_cond_destroy(&g_timerCond);
+        g_timerRunning = 0;
+    }
+
+    /* force the writes: the shadow may be stale */
+    g_conveyorDeadline.tv_sec   = 0;
+    g_conveyorRetryMs           = 0;
+    g_verifyPeriodMs            = 0;
+    g_conveyorShadow            = -1;
+    g_hotplateShadow            = -1;
+    Mezzanine_conveyorWrite(CONVEYOR_STOPPED);
+    Mezzanine_hotplateWrite(HOTPLATE_OFF);
+
+    pthread_mutex_unlock(&g_outputLock);
+    Mezzanine_ButtonsDisarmEvents();
+
+    GpioGroupRelease(g_hotplate);
+    GpioGroupRelease(g_conveyor);
+    GpioGroupRelease(g_buttons);
+    g_hotplate = NULL;
+    g_conveyor = NULL;
+    g_buttons  = NULL;
+}
+
+static int Mezzanine_TempSensorRawToCelsius( int rawTemp, double * celsius )
+{
+    if (0 != (rawTemp & TEMPERATURE_ERROR_FLAG)) return (E_BAD_TEMPERATURE);
+
+    *celsius = (double) rawTemp / 50.0 - 273.15;
+
+    return (0);
 }
 
 int Mezzanine_TempSensorGetTObject( double * celsius )
@@ -254,13 +971,30 @@ int Mezzanine_TempSensorGetTObject( double * celsius )
                             );
 
     if (0 == result)
-    {
-        if (0 == (rawTemp & TEMPERATURE_ERROR_FLAG))
-            *celsius = (double) rawTemp / 50.0 - 273.15;
-        else
-            result = -1;
-    }
+        result = Mezzanine_TempSensorRawToCelsius(rawTemp, celsius);
 
     return (result);
 }
 
+int Mezzanine_TempSensorGetTBoth( double * ambient, double * object )
+{
+    int result;
+    int rawAmbient;
+    int rawObject;
+
+    result = I2cReadRegisterPair(   I2C_BUS,
+                                    I2C_SLAVE_ADDRESS,
+                                    I2C_REGISTER_T_AMBIENT,
+                                    I2C_REGISTER_T_OBJECT,
+                                    &rawAmbient,
+                                    &rawObject
+                                );
+
+    if (0 == result)
+        result = Mezzanine_TempSensorRawToCelsius(rawAmbient, ambient);
+
+    if (0 == result)
+        result = Mezzanine_TempSensorRawToCelsius(rawObject, object);
+
+    return (result);
+}
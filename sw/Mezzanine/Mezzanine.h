@@ -11,6 +11,12 @@ Description:
 This file contains the API for controlling the mezzanine hardware.
 */
 
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <poll.h>
+
 #include "../DEBUG_PRINT.h"
 
 #include "gpio.h"
@@ -40,21 +46,74 @@ This file contains the API for controlling the mezzanine hardware.
 #define CONVEYOR_FORWARD    1
 #define CONVEYOR_REVERSE    2
 
+/* a failed timed stop is retried after this, doubling up to the maximum */
+#define CONVEYOR_STOP_RETRY_MS      (10)
+#define CONVEYOR_STOP_RETRY_MAX_MS  (1000)
+
 #define STOP_PRESSED        GPIO_HIGH
 #define START_PRESSED       GPIO_LOW
 
+#define BUTTON_STOP         0
+#define BUTTON_START        1
+
+/* a button's level counts once its line has had no edge for this long, or
+   once it has chattered for the longer time */
+#define BUTTON_DEBOUNCE_NS      (20 * 1000 * 1000ULL)
+#define BUTTON_SETTLE_MAX_NS    (200 * 1000 * 1000ULL)
+
+struct MEZZANINE_BUTTON_EVENT
+{
+    int         button;     /* BUTTON_STOP or BUTTON_START                  */
+    int         pressed;    /* nonzero for a press, zero for a release      */
+    uint64_t    timestamp;  /* kernel timestamp of the edge, nanoseconds    */
+};
+
 int Mezzanine_HotplateInit( void );
 int Mezzanine_ConveyorInit( void );
 int Mezzanine_ButtonsInit( void );
 int Mezzanine_TempSensorInit( void );
+void Mezzanine_Shdn( void );
 
 int Mezzanine_HotplateGetState( int * state );
 int Mezzanine_HotplateSetState( int state );
 int Mezzanine_ConveyorGetState( int * state );
 int Mezzanine_ConveyorSetState( int state );
+
+/*  Mezzanine_ConveyorRunFor( state , milliseconds )
+ *  Sets the conveyor state and returns immediately; the conveyor is stopped
+ *  by a timer thread once milliseconds have elapsed.  A later SetState or
+ *  RunFor replaces the pending stop.
+ */
+int Mezzanine_ConveyorRunFor( int state, unsigned int milliseconds );
+/*  Mezzanine_VerifyOutputs()
+ *  Reads the outputs back and returns how many differ from their last
+ *  commanded values.  Diverged outputs are logged and rewritten on their
+ *  next SetState.  A period of 0 disables the periodic pass.
+ */
+int             Mezzanine_VerifyOutputs     ( void );
+int             Mezzanine_SetVerifyPeriod   ( unsigned int milliseconds );
+unsigned long   Mezzanine_GetDivergenceCount( void );
+
 int Mezzanine_StopButtonGetState( int * state );
 int Mezzanine_StartButtonGetState( int * state );
+int Mezzanine_ButtonsGetState( int * stop, int * start );
 int Mezzanine_TempSensorGetTObject( double * celsius );
 
+/*  Mezzanine_ButtonsArmEvents()
+ *  Arms edge events on the START and STOP lines.  Returns a descriptor
+ *  which becomes readable when an event is pending, or a negative value.
+ *  Mezzanine_ButtonsReadEvent() returns 1 if it stored an event, 0 if none
+ *  arrived within timeoutMs (-1 waits indefinitely), or a negative error.
+ *  After an edge it waits for the line to settle (BUTTON_DEBOUNCE_NS with
+ *  no further edge, but at most BUTTON_SETTLE_MAX_NS), so it may return up
+ *  to that much after timeoutMs.  The event's timestamp is its first edge.
+ */
+int  Mezzanine_ButtonsArmEvents     ( void );
+void Mezzanine_ButtonsDisarmEvents  ( void );
+int  Mezzanine_ButtonsGetEventFd    ( void );
+int  Mezzanine_ButtonsReadEvent     (   struct MEZZANINE_BUTTON_EVENT * event,
+                                        int                             timeoutMs );
+int Mezzanine_TempSensorGetTBoth( double * ambient, double * object );
+
 #endif /* MEZZANINE_H */
 
@@ -0,0 +1,280 @@
+
+/*
+File:   ProcessHelper.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements a long-lived helper process for script-based hardware
+access.  ProcessHelper_start() spawns the helper with one end of a Unix
+socket pair as its stdin and stdout.  Each request is a single line
+holding the script path and its arguments; the helper answers with the
+script's output followed by a line "@@ <status>".
+
+Requests are serialized with a mutex, so the helper may be shared between
+threads.  If the helper dies, it is marked as stopped and callers fall
+back to starting processes themselves.  A request that has not been
+answered within PROCESS_HELPER_TIMEOUT_MS is abandoned: the helper and
+whatever it is running are killed, a fresh helper is started for the next
+request, and the caller falls back for this one.
+*/
+
+#include "ProcessHelper.h"
+
+static pthread_mutex_t  g_lock      = PTHREAD_MUTEX_INITIALIZER;
+static int              g_socket    = -1;
+static pid_t            g_pid       = -1;
+static char             g_path[PROCESS_HELPER_LINE_SIZE];
+
+/* reply bytes received but not yet returned as lines */
+static char             g_buffer[PROCESS_HELPER_LINE_SIZE];
+static size_t           g_buffered  = 0;
+
+
+/* must hold g_lock */
+static void ProcessHelper_reap( void )
+{
+    if (-1 != g_socket) close(g_socket);
+
+    g_socket    = -1;
+    g_buffered  = 0;
+
+    if (-1 != g_pid)
+    {
+        while ((-1 == waitpid(g_pid, NULL, 0)) && (EINTR == errno))
+            ; /* retry */
+        g_pid = -1;
+    }
+}
+
+/* The helper runs in a process group of its own, so that a script it is
+   stuck in goes down with it.  Must hold g_lock. */
+static int ProcessHelper_spawn( void )
+{
+    extern char **  environ;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    char *  argv[] = { g_path, NULL };
+    int     fds[2];
+    int     status = PHLP_E_NONE;
+
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+        return (PHLP_E_SOCKET);
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    if (0 != posix_spawn(&g_pid, g_path, &actions, &attributes, argv, environ))
+    {
+        g_pid  = -1;
+        status = PHLP_E_SPAWN;
+    }
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (PHLP_E_NONE != status)
+        close(fds[0]);
+    else
+        g_socket = fds[0];
+
+    return (status);
+}
+
+/* Read one line of reply into line, waiting no later than deadlineMs (on
+   CLOCK_MONOTONIC).  Returns 1 with a line, 0 at end of file or on an
+   error, or -1 on timeout.  A line longer than the buffer is returned in
+   pieces.  Must hold g_lock. */
+static int ProcessHelper_readLine(  char *      line,
+                                    size_t      lineSize,
+                                    int64_t     deadlineMs  )
+{
+    struct pollfd   pollFd;
+    struct timespec now;
+    char *          newline;
+    size_t          length;
+    ssize_t         nRead;
+    int64_t         remainingMs;
+    int             nReady;
+
+    while (1)
+    {
+        newline = memchr(g_buffer, '\n', g_buffered);
+        if ((NULL != newline) || (g_buffered >= lineSize - 1))
+        {
+            length = (NULL != newline) ? (size_t) (newline - g_buffer) + 1
+                                       : lineSize - 1;
+            memcpy(line, g_buffer, length);
+            line[length] = '\0';
+
+            g_buffered -= length;
+            memmove(g_buffer, g_buffer + length, g_buffered);
+            return (1);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remainingMs = deadlineMs - ((int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+        if (remainingMs <= 0) return (-1);
+
+        pollFd.fd       = g_socket;
+        pollFd.events   = POLLIN;
+        nReady = poll(&pollFd, 1, (int) remainingMs);
+        if ((-1 == nReady) && (EINTR == errno)) continue;
+        if (-1 == nReady) return (0);
+        if (0 == nReady) return (-1);
+
+        nRead = read(g_socket, g_buffer + g_buffered, sizeof(g_buffer) - g_buffered);
+        if ((-1 == nRead) && (EINTR == errno)) continue;
+        if (nRead <= 0) return (0);
+
+        g_buffered += nRead;
+    }
+}
+
+int ProcessHelper_start( const char * path )
+{
+    int status = PHLP_E_NONE;
+
+    if (strlen(path) >= sizeof(g_path)) return (PHLP_E_LENGTH);
+
+    pthread_mutex_lock(&g_lock);
+
+    if (-1 == g_socket)
+    {
+        strcpy(g_path, path);
+        status = ProcessHelper_spawn();
+    }
+
+    pthread_mutex_unlock(&g_lock);
+
+    return (status);
+}
+
+void ProcessHelper_stop( void )
+{
+    pthread_mutex_lock(&g_lock);
+
+    /* the helper exits when it reads end-of-file */
+    if (-1 != g_socket) shutdown(g_socket, SHUT_WR);
+    ProcessHelper_reap();
+
+    pthread_mutex_unlock(&g_lock);
+}
+
+int ProcessHelper_isRunning( void )
+{
+    return (-1 != __atomic_load_n(&g_socket, __ATOMIC_RELAXED));
+}
+
+int ProcessHelper_runLine(  const char *    commandLine,
+                            char *          output,
+                            size_t          outputSize  )
+{
+    char    line[PROCESS_HELPER_LINE_SIZE];
+    struct timespec now;
+    int64_t deadlineMs;
+    size_t  length;
+    size_t  used    = 0;
+    size_t  sent    = 0;
+    ssize_t nSent;
+    int     exitStatus;
+    int     result  = 0;
+    int     status  = PHLP_E_IO;
+
+    length = strlen(commandLine);
+    if (length >= sizeof(line) - 1) return (PHLP_E_LENGTH);
+
+    memcpy(line, commandLine, length);
+    line[length++] = '\n';
+
+    output[0] = '\0';
+
+    pthread_mutex_lock(&g_lock);
+
+    do
+    {
+        if (-1 == g_socket) { status = PHLP_E_NOT_RUNNING; break; }
+
+        /* MSG_NOSIGNAL: a dead helper must not raise SIGPIPE here */
+        while (sent < length)
+        {
+            nSent = send(g_socket, line + sent, length - sent, MSG_NOSIGNAL);
+            if ((-1 == nSent) && (EINTR == errno)) continue;
+            if (nSent <= 0) break;
+            sent += nSent;
+        }
+        if (sent < length) break;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadlineMs = (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000
+                   + PROCESS_HELPER_TIMEOUT_MS;
+
+        while (1 == (result = ProcessHelper_readLine(line, sizeof(line), deadlineMs)))
+        {
+            if (1 == sscanf(line, "@@ %d", &exitStatus))
+            {
+                status = W_EXITCODE(exitStatus, 0);
+                break;
+            }
+
+            /* keep as much output as fits */
+            length = strlen(line);
+            if (used + length >= outputSize) length = outputSize - used - 1;
+
+            memcpy(output + used, line, length);
+            used += length;
+            output[used] = '\0';
+        }
+    } while (0);
+
+    if ((PHLP_E_IO == status) && (-1 == result))
+    {
+        /* a hung script would hold every later request too; start over */
+        fprintf(stderr, "ProcessHelper: no reply to '%s'; restarting the helper.\n",
+                commandLine);
+        kill(-g_pid, SIGKILL);
+        ProcessHelper_reap();
+        if (PHLP_E_NONE != ProcessHelper_spawn())
+            fprintf(stderr, "ProcessHelper: could not restart the helper, falling back.\n");
+    }
+    else if (PHLP_E_IO == status)
+    {
+        fprintf(stderr, "ProcessHelper: helper lost, falling back.\n");
+        ProcessHelper_reap();
+    }
+
+    pthread_mutex_unlock(&g_lock);
+
+    return (status);
+}
+
+int ProcessHelper_runArgv(  char * const    argv[],
+                            char *          output,
+                            size_t          outputSize  )
+{
+    char    commandLine[PROCESS_HELPER_LINE_SIZE];
+    size_t  used = 0;
+    int     length;
+    int     i;
+
+    for (i = 0; NULL != argv[i]; i++)
+    {
+        length = snprintf(  commandLine + used,
+                            sizeof(commandLine) - used,
+                            (0 == i) ? "%s" : " %s",
+                            argv[i]     );
+
+        if ((length < 0) || ((size_t) length >= sizeof(commandLine) - used))
+            return (PHLP_E_LENGTH);
+
+        used += length;
+    }
+
+    return (ProcessHelper_runLine(commandLine, output, outputSize));
+}
@@ -0,0 +1,64 @@
+
+#ifndef PROCESSHELPER_H
+#define PROCESSHELPER_H
+
+/*
+File:   ProcessHelper.h
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file declares the interface to a long-lived helper process which runs
+script requests on behalf of RunProcessByTemplate().  While the helper is
+running, RunProcessByTemplate() sends its argv to it over a Unix socket
+instead of starting a new process, so the scripts under ./scripts keep
+working without a fork per call.  The helper splits each request into
+words and runs no shell, so RunProcessByFormat(), whose commands may use
+shell syntax, always goes through popen().
+*/
+
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "RunProcessByFormat.h"
+
+#define PROCESS_HELPER_PATH         "./scripts/helper/hw-helper"
+#define PROCESS_HELPER_LINE_SIZE    (256)
+
+/* a request not answered in this time is abandoned, and the helper
+   restarted */
+#define PROCESS_HELPER_TIMEOUT_MS   (2000)
+
+enum PROCESS_HELPER_ERROR
+{
+    PHLP_E_NONE         =  0,
+    PHLP_E_SOCKET       = -11,
+    PHLP_E_SPAWN        = -12,
+    PHLP_E_NOT_RUNNING  = -13,
+    PHLP_E_IO           = -14,
+    PHLP_E_LENGTH       = -15
+};
+
+int     ProcessHelper_start     ( const char * path );
+void    ProcessHelper_stop      ( void );
+int     ProcessHelper_isRunning ( void );
+
+/*  ProcessHelper_runLine( commandLine , output , outputSize )
+ *  Runs one request and stores its output, NUL-terminated, in output.
+ *  Returns the request's status encoded as by waitpid(), or an error;
+ *  PHLP_E_IO if the helper died or timed out, in which case the caller
+ *  should run the command itself.
+ */
+int     ProcessHelper_runLine   (   const char *    commandLine,
+                                    char *          output,
+                                    size_t          outputSize  );
+
+int     ProcessHelper_runArgv   (   char * const    argv[],
+                                    char *          output,
+                                    size_t          outputSize  );
+
+#endif /* PROCESSHELPER_H */
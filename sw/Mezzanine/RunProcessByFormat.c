@@ -18,8 +18,14 @@ For example:
 
 "echo $(( %d + %d )) : %d"
 
+The command part is run by /bin/sh through popen(), so it may use shell
+syntax, as above.  Templated runs (see RunProcessByTemplate()) have no
+shell; while a ProcessHelper is running they are sent to it rather than
+started with posix_spawn(), and its reply is scanned instead.
+
 */
 #include "RunProcessByFormat.h"
+#include "ProcessHelper.h"
 
 int RunProcessByFormat( const char * const format, ... )
 {
@@ -65,7 +71,8 @@ int RunProcessByFormat( const char * const format, ... )
                 commandFormat++
             ) va_arg(args, int);
 
-        /* run the populated command */
+        /* run the populated command (never through the helper, which
+           only word-splits its requests: this may use shell syntax) */
         pipe = popen(command, "r");
         if (NULL == pipe) { result = RPBF_E_POPEN; break; }
 
@@ -90,3 +97,280 @@ int RunProcessByFormat( const char * const format, ... )
     return (result);
 }
 
+
+/* returns the va_arg class of the single conversion in token, 0 if none,
+   or -1 if the token cannot be templated (int, since char may be unsigned) */
+static int RunProcessTemplate_classify( const char * token )
+{
+    const char *    p;
+    int             type = 0;
+
+    for (p = strchr(token, '%'); NULL != p; p = strchr(p, '%'))
+    {
+        p++;
+        if ('%' == *p) { p++; continue; }
+
+        /* only one conversion per argument token */
+        if (0 != type) return (-1);
+
+        p += strspn(p, "#0- +'123456789.");
+        if ('l' == *p || 'h' == *p) return (-1);
+
+        switch (*p)
+        {
+            case 'd': case 'i': case 'o': case 'u':
+            case 'x': case 'X': case 'c':
+                type = 'd';
+                break;
+
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G':
+                type = 'f';
+                break;
+
+            case 's':
+                type = 's';
+                break;
+
+            default:
+                return (-1);
+        }
+    }
+
+    return (type);
+}
+
+struct RPBF_TEMPLATE * RunProcessTemplate_compile( const char * const format )
+{
+    struct RPBF_TEMPLATE *  t;
+    char *                  outputFormat;
+    char *                  token;
+    char *                  save;
+    int                     valid = 1;
+
+    t = calloc(1, sizeof(struct RPBF_TEMPLATE));
+    if (NULL == t) return (NULL);
+
+    t->storage = strdup(format);
+    if (NULL == t->storage) { free(t); return (NULL); }
+
+    /* split "command : outputs" */
+    outputFormat = strchr(t->storage, ':');
+    if (NULL != outputFormat) *outputFormat++ = '\0';
+
+    for (   token = strtok_r(t->storage, " \t", &save);
+            valid && (NULL != token);
+            token = strtok_r(NULL, " \t", &save)    )
+    {
+        if (RPBF_MAX_ARGS == t->nArgs) { valid = 0; break; }
+
+        t->argTypes[t->nArgs] = RunProcessTemplate_classify(token);
+        if (-1 == t->argTypes[t->nArgs]) valid = 0;
+
+        t->args[t->nArgs++] = token;
+    }
+
+    for (   token = (NULL != outputFormat)
+                    ? strtok_r(outputFormat, " \t", &save)
+                    : NULL;
+            valid && (NULL != token);
+            token = strtok_r(NULL, " \t", &save)    )
+    {
+        if (RPBF_MAX_OUTPUTS == t->nOutputs) { valid = 0; break; }
+
+        /* append %n to learn how much of the output each scan consumed */
+        t->outputs[t->nOutputs] = malloc(strlen(token) + 3);
+        if (NULL == t->outputs[t->nOutputs]) { valid = 0; break; }
+
+        sprintf(t->outputs[t->nOutputs++], "%s%%n", token);
+    }
+
+    if (!valid || (0 == t->nArgs) || (0 != t->argTypes[0]))
+    {
+        RunProcessTemplate_free(t);
+        t = NULL;
+    }
+
+    return (t);
+}
+
+void RunProcessTemplate_free( struct RPBF_TEMPLATE * t )
+{
+    int i;
+
+    if (NULL == t) return;
+
+    for (i = 0; i < t->nOutputs; i++)
+        free(t->outputs[i]);
+
+    free(t->storage);
+    free(t);
+}
+
+/* scans output into the variadic arguments following the template's inputs */
+static int RunProcessTemplate_scan( const struct RPBF_TEMPLATE *    t,
+                                    const char *                    output,
+                                    int                             status,
+                                    va_list                         args    )
+{
+    size_t  used = 0;
+    int     length;
+    int     i;
+
+    for (i = 0; i < t->nOutputs; i++)
+    {
+        length = 0;
+        if (1 > sscanf(output + used, t->outputs[i],
+                       va_arg(args, void *), &length)) break;
+        used += length;
+    }
+
+    return (status);
+}
+
+int RunProcessByTemplateV( const struct RPBF_TEMPLATE * t, va_list args )
+{
+    extern char **  environ;
+
+    char            argBuffer[RPBF_ARG_BUFFER_SIZE];
+    char            outBuffer[RPBF_OUTPUT_BUFFER_SIZE];
+    char *          argv[RPBF_MAX_ARGS + 1];
+
+    posix_spawn_file_actions_t actions;
+    pid_t           pid;
+    int             fds[2];
+    int             status;
+    int             i;
+    int             length;
+    size_t          used        = 0;
+    size_t          outLength   = 0;
+    ssize_t         nRead;
+
+    /* populate the argv template with variadic arguments */
+    for (i = 0; i < t->nArgs; i++)
+    {
+        switch (t->argTypes[i])
+        {
+            case 'd':
+                length = snprintf(  argBuffer + used,
+                                    sizeof(argBuffer) - used,
+                                    t->args[i], va_arg(args, int)       );
+                break;
+
+            case 'f':
+                length = snprintf(  argBuffer + used,
+                                    sizeof(argBuffer) - used,
+                                    t->args[i], va_arg(args, double)    );
+                break;
+
+            case 's':
+                length = snprintf(  argBuffer + used,
+                                    sizeof(argBuffer) - used,
+                                    t->args[i], va_arg(args, char *)    );
+                break;
+
+            default:
+                argv[i] = t->args[i];
+                continue;
+        }
+
+        if ((length < 0) || ((size_t) length >= sizeof(argBuffer) - used))
+            return (RPBF_E_FORMAT);
+
+        argv[i] = argBuffer + used;
+        used   += length + 1;
+    }
+    argv[t->nArgs] = NULL;
+
+    /* route through the helper process if one is running */
+    status = PHLP_E_NOT_RUNNING;
+    if (ProcessHelper_isRunning())
+        status = ProcessHelper_runArgv(argv, outBuffer, sizeof(outBuffer));
+
+    if (0 <= status)
+        return (RunProcessTemplate_scan(t, outBuffer, status, args));
+
+    if (0 != pipe2(fds, O_CLOEXEC)) return (RPBF_E_PIPE);
+
+    /* child's stdout is the write end of the pipe */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+    status = posix_spawn(&pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (0 != status)
+    {
+        close(fds[0]);
+        return (RPBF_E_SPAWN);
+    }
+
+    /* collect output; anything past the buffer is drained and dropped */
+    do
+    {
+        if (outLength < sizeof(outBuffer) - 1)
+        {
+            nRead = read(   fds[0],
+                            outBuffer + outLength,
+                            sizeof(outBuffer) - 1 - outLength   );
+            if (nRead > 0) outLength += nRead;
+        }
+        else
+        {
+            nRead = read(fds[0], argBuffer, sizeof(argBuffer));
+        }
+    } while ((nRead > 0) || ((-1 == nRead) && (EINTR == errno)));
+
+    outBuffer[outLength] = '\0';
+    close(fds[0]);
+
+    while ((-1 == waitpid(pid, &status, 0)) && (EINTR == errno))
+        ; /* retry */
+
+    return (RunProcessTemplate_scan(t, outBuffer, status, args));
+}
+
+int RunProcessByTemplate( const struct RPBF_TEMPLATE * t, ... )
+{
+    va_list args;
+    int     result;
+
+    va_start(args, t);
+    result = RunProcessByTemplateV(t, args);
+    va_end(args);
+
+    return (result);
+}
+
+int RunProcessByFormatCached(   struct RPBF_TEMPLATE ** compiled,
+                                const char * const      format, ... )
+{
+    struct RPBF_TEMPLATE *  t;
+    struct RPBF_TEMPLATE *  expected = NULL;
+    va_list                 args;
+    int                     result;
+
+    t = __atomic_load_n(compiled, __ATOMIC_ACQUIRE);
+    if (NULL == t)
+    {
+        t = RunProcessTemplate_compile(format);
+        if (NULL == t) return (RPBF_E_FORMAT);
+
+        /* another thread may have compiled it first */
+        if (!__atomic_compare_exchange_n(   compiled, &expected, t, 0,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE    ))
+        {
+            RunProcessTemplate_free(t);
+            t = expected;
+        }
+    }
+
+    va_start(args, format);
+    result = RunProcessByTemplateV(t, args);
+    va_end(args);
+
+    return (result);
+}
@@ -12,26 +12,75 @@ This file declares a function RunProcessByFormat, which both starts a
 process with parameters and interprets the output based on a provided
 format string.  This essentially allows for calling external scripts
 as if they were functions.
+
+A format string may also be compiled once with RunProcessTemplate_compile()
+into an argv template and run any number of times with
+RunProcessByTemplate().  Templated runs start the process directly with
+posix_spawn() (no intermediate /bin/sh) and read its output through a pipe
+into a stack buffer, so they perform no heap allocation.  Each argument
+token may hold at most one conversion (%d, %x, %s, %f, ...), and since no
+shell is involved, the command part may not use shell syntax.
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* pipe2() */
+#endif
+
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
 
 enum RUN_PROCESS_BY_FORMAT_ERROR
 {
     RPBF_E_NONE         =  0,
     RPBF_E_MALLOC       = -1,
     RPBF_E_MEMSTREAM    = -2,
-    RPBF_E_POPEN        = -3
+    RPBF_E_POPEN        = -3,
+    RPBF_E_FORMAT       = -4,
+    RPBF_E_PIPE         = -5,
+    RPBF_E_SPAWN        = -6
+};
+
+#define RPBF_MAX_ARGS           (16)
+#define RPBF_MAX_OUTPUTS        (8)
+#define RPBF_ARG_BUFFER_SIZE    (256)
+#define RPBF_OUTPUT_BUFFER_SIZE (256)
+
+struct RPBF_TEMPLATE
+{
+    char *  storage;                    /* tokenized copy of the format */
+    int     nArgs;
+    char *  args[RPBF_MAX_ARGS];        /* per-token printf formats     */
+    int     argTypes[RPBF_MAX_ARGS];    /* 0 for literal tokens         */
+    int     nOutputs;
+    char *  outputs[RPBF_MAX_OUTPUTS];  /* scanf formats ending in %n   */
 };
 
 /*  RunProcessByFormat( format , ... )
  */
 int RunProcessByFormat( const char * const runFormat, ... );
 
+/*  RunProcessTemplate_compile( format )
+ *  Returns NULL if the format cannot be expressed as an argv template.
+ */
+struct RPBF_TEMPLATE *  RunProcessTemplate_compile( const char * const format );
+void                    RunProcessTemplate_free( struct RPBF_TEMPLATE * t );
+
+int RunProcessByTemplate    ( const struct RPBF_TEMPLATE * t, ... );
+int RunProcessByTemplateV   ( const struct RPBF_TEMPLATE * t, va_list args );
+
+/*  RunProcessByFormatCached( compiled , format , ... )
+ *  Compiles format into *compiled on first use, then runs the template.
+ */
+int RunProcessByFormatCached(   struct RPBF_TEMPLATE ** compiled,
+                                const char * const      format, ... );
+
 #endif /* RUNPROCESSBYFORMAT_H */
 
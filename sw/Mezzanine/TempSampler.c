@@ -0,0 +1,214 @@
+
+/*
+File:   TempSampler.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements a background temperature sampler.
+
+The sampler thread is the only producer.  It writes each sample into the
+next slot of the ring, then publishes it by advancing g_head.  Readers
+never block the producer: they copy the slots they want, then re-read
+g_head, and retry if the producer may have overwritten any of them in the
+meantime.
+
+Readings which the sensor flags with TEMPERATURE_ERROR_FLAG are not pushed
+into the ring, but counted separately from failed bus transfers.
+*/
+
+#include "TempSampler.h"
+
+#define TEMP_SAMPLER_MASK   (TEMP_SAMPLER_CAPACITY - 1)
+
+static struct TEMP_SAMPLE   g_ring[TEMP_SAMPLER_CAPACITY];
+static uint64_t             g_head          = 0;    /* samples published */
+
+static uint64_t             g_nFlagged      = 0;
+static uint64_t             g_nErrors       = 0;
+
+static pthread_t            g_thread;
+static int                  g_running       = 0;
+static int                  g_stopRequested = 0;
+static uint64_t             g_periodNs      = 0;
+
+
+uint64_t TempSampler_now( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+static void TempSampler_push( double celsius, uint64_t timestamp )
+{
+    struct TEMP_SAMPLE * slot;
+    uint64_t head;
+
+    head = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    slot = &g_ring[head & TEMP_SAMPLER_MASK];
+
+    __atomic_store(&slot->celsius,   &celsius,   __ATOMIC_RELAXED);
+    __atomic_store(&slot->timestamp, &timestamp, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&g_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void * TempSampler_thread( void * dontcare )
+{
+    struct timespec deadline;
+    double          celsius;
+    int             result;
+
+    (void) dontcare;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!__atomic_load_n(&g_stopRequested, __ATOMIC_RELAXED))
+    {
+        result = Mezzanine_TempSensorGetTObject(&celsius);
+
+        if (0 == result)
+            TempSampler_push(celsius, TempSampler_now());
+        else if (E_BAD_TEMPERATURE == result)
+            __atomic_add_fetch(&g_nFlagged, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&g_nErrors, 1, __ATOMIC_RELAXED);
+
+        /* absolute deadlines keep the rate from drifting; a period of a
+           second or more would overflow a 32-bit tv_nsec, so split it */
+        deadline.tv_sec  += (time_t) (g_periodNs / 1000000000ULL);
+        deadline.tv_nsec += (long)   (g_periodNs % 1000000000ULL);
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                        &deadline, NULL))
+            ; /* retry */
+    }
+
+    return (NULL);
+}
+
+int TempSampler_start( double rateHz )
+{
+    if (g_running) return (TEMP_SAMPLER_E_NONE);
+
+    if (rateHz <= 0.0) rateHz = TEMP_SAMPLER_RATE_HZ;
+    g_periodNs = (uint64_t) (1e9 / rateHz);
+
+    __atomic_store_n(&g_stopRequested, 0, __ATOMIC_RELAXED);
+
+    if (0 != pthread_create(&g_thread, NULL, TempSampler_thread, NULL))
+        return (TEMP_SAMPLER_E_THREAD);
+
+    g_running = 1;
+
+    return (TEMP_SAMPLER_E_NONE);
+}
+
+void TempSampler_stop( void )
+{
+    if (!g_running) return;
+
+    __atomic_store_n(&g_stopRequested, 1, __ATOMIC_RELAXED);
+    pthread_join(g_thread, NULL);
+
+    g_running = 0;
+}
+
+int TempSampler_isRunning( void )
+{
+    return (g_running);
+}
+
+int TempSampler_getWindow(  struct TEMP_SAMPLE *    samples,
+                            int                     maxSamples  )
+{
+    uint64_t head;
+    uint64_t first;
+    uint64_t i;
+    int      nSamples;
+
+    if (maxSamples > TEMP_SAMPLER_CAPACITY) maxSamples = TEMP_SAMPLER_CAPACITY;
+    if (maxSamples <= 0) return (0);
+
+    do
+    {
+        head = __atomic_load_n(&g_head, __ATOMIC_ACQUIRE);
+
+        /* one slot of slack for the sample being written */
+        nSamples = (head < (uint64_t) maxSamples) ? (int) head : maxSamples;
+        if (nSamples == TEMP_SAMPLER_CAPACITY) nSamples--;
+        first = head - nSamples;
+
+        for (i = 0; i < (uint64_t) nSamples; i++)
+        {
+            struct TEMP_SAMPLE * slot = &g_ring[(first + i) & TEMP_SAMPLER_MASK];
+
+            __atomic_load(&slot->celsius,   &samples[i].celsius,   __ATOMIC_RELAXED);
+            __atomic_load(&slot->timestamp, &samples[i].timestamp, __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        /* retry if the producer lapped the oldest slot we copied */
+    } while (__atomic_load_n(&g_head, __ATOMIC_RELAXED) - first
+             >= TEMP_SAMPLER_CAPACITY);
+
+    return (nSamples);
+}
+
+int TempSampler_getLatest( struct TEMP_SAMPLE * sample )
+{
+    if (1 != TempSampler_getWindow(sample, 1)) return (TEMP_SAMPLER_E_EMPTY);
+
+    return (TEMP_SAMPLER_E_NONE);
+}
+
+int TempSampler_getMedian( int nSamples, double * celsius )
+{
+    struct TEMP_SAMPLE  window[TEMP_SAMPLER_CAPACITY];
+    double              values[TEMP_SAMPLER_CAPACITY];
+    double              value;
+    int                 n;
+    int                 i;
+    int                 j;
+
+    n = TempSampler_getWindow(window, nSamples);
+    if (0 == n) return (TEMP_SAMPLER_E_EMPTY);
+
+    /* insertion sort: windows are small */
+    for (i = 0; i < n; i++)
+    {
+        value = window[i].celsius;
+        for (j = i; (j > 0) && (values[j - 1] > value); j--)
+            values[j] = values[j - 1];
+        values[j] = value;
+    }
+
+    *celsius = (n & 1) ? values[n / 2]
+                       : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+
+    return (TEMP_SAMPLER_E_NONE);
+}
+
+uint64_t TempSampler_getSampleCount( void )
+{
+    return (__atomic_load_n(&g_head, __ATOMIC_RELAXED));
+}
+
+uint64_t TempSampler_getFlaggedCount( void )
+{
+    return (__atomic_load_n(&g_nFlagged, __ATOMIC_RELAXED));
+}
+
+uint64_t TempSampler_getErrorCount( void )
+{
+    return (__atomic_load_n(&g_nErrors, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,64 @@
+
+#ifndef TEMPSAMPLER_H
+#define TEMPSAMPLER_H
+
+/*
+File:   TempSampler.h
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file declares the API for a background temperature sampler.  While
+started, a thread reads the object temperature at a fixed rate and pushes
+timestamped samples into a ring buffer.  The newest sample, a median of
+recent samples, or a window of samples may be read at any time without
+blocking the sampler.
+
+Only one thread may read from the sampler at a time.  Patty_isDone() and
+the sweep dwell callback start the sampler when the probe reaches a patty
+and stop it before the robot moves on, so samples are only taken at
+patties; the i2c functions serialize the sampler's bus access with the
+rest of the program.
+*/
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "Mezzanine.h"
+
+/* must be a power of two */
+#define TEMP_SAMPLER_CAPACITY       (64)
+#define TEMP_SAMPLER_RATE_HZ        (10.0)
+
+#define TEMP_SAMPLER_E_NONE         ( 0)
+#define TEMP_SAMPLER_E_EMPTY        (-1)
+#define TEMP_SAMPLER_E_THREAD       (-2)
+
+struct TEMP_SAMPLE
+{
+    double      celsius;
+    uint64_t    timestamp;  /* CLOCK_MONOTONIC, nanoseconds */
+};
+
+int      TempSampler_start          ( double rateHz );
+void     TempSampler_stop           ( void );
+int      TempSampler_isRunning      ( void );
+
+int      TempSampler_getLatest      ( struct TEMP_SAMPLE * sample );
+int      TempSampler_getMedian      ( int nSamples, double * celsius );
+
+/*  TempSampler_getWindow( samples , maxSamples )
+ *  Copies up to maxSamples of the newest samples, oldest first, and returns
+ *  the number copied.
+ */
+int      TempSampler_getWindow      (   struct TEMP_SAMPLE *    samples,
+                                        int                     maxSamples  );
+
+uint64_t TempSampler_getSampleCount ( void );
+uint64_t TempSampler_getFlaggedCount( void );
+uint64_t TempSampler_getErrorCount  ( void );
+
+uint64_t TempSampler_now            ( void );
+
+#endif /* TEMPSAMPLER_H */
@@ -6,35 +6,401 @@ Author: Peter Lapets
 
 Description:
 This file contains functions used for manipulation of general purpose I/O
-as exposed by the /sys/class/gpio interface.  These are mostly wrappers for
-RunProcessByFormat() which call their corresponding scripts.
+as exposed by the /sys/class/gpio interface.
+
+With GPIO_BACKEND_SCRIPT, these are wrappers for RunProcessByFormatCached()
+which call their corresponding scripts.  With GPIO_BACKEND_SYSFS, the same files
+the scripts touch are accessed directly.  The value file of each pin is
+opened on first use and kept open, so that a read or write of a pin is a
+single pread()/pwrite() rather than a process spawn.  The descriptor cache
+is guarded by g_valueLock, since the subsystems are initialized from
+several threads at once.
+
+The GpioGroup functions use the GPIO character device instead, requesting
+several lines of one chip behind a single line handle.  The GpioEvent
+functions request a single line from it for edge events.
 */
 
 #include "gpio.h"
 
+static int g_backend = GPIO_BACKEND_SYSFS;
+
+/* cached /sys/class/gpio/gpioN/value descriptors, -1 if not open */
+static int g_valueFd[GPIO_MAX_NUMBER] = { [0 ... GPIO_MAX_NUMBER - 1] = -1 };
+static pthread_mutex_t g_valueLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* script argv templates, compiled on first use */
+static struct RPBF_TEMPLATE * g_scriptExport        = NULL;
+static struct RPBF_TEMPLATE * g_scriptUnexport      = NULL;
+static struct RPBF_TEMPLATE * g_scriptSetDirection  = NULL;
+static struct RPBF_TEMPLATE * g_scriptGetValue      = NULL;
+static struct RPBF_TEMPLATE * g_scriptSetValue      = NULL;
+
+
+static int GpioSysfs_writeFile( const char * path, const char * text )
+{
+    int fd;
+    int status = GPIO_E_NONE;
+    size_t length = strlen(text);
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (-1 == fd) return (GPIO_E_OPEN);
+
+    if ((ssize_t) length != write(fd, text, length))
+        status = GPIO_E_WRITE;
+
+    close(fd);
+
+    return (status);
+}
+
+static int GpioSysfs_isExported( int gpioNumber )
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), GPIO_SYSFS_PATH "gpio%d", gpioNumber);
+
+    return (0 == access(path, F_OK));
+}
+
+/* returns the cached value descriptor for a pin, opening it if needed */
+static int GpioSysfs_valueFd( int gpioNumber )
+{
+    char path[64];
+    int fd;
+
+    if ((gpioNumber < 0) || (gpioNumber >= GPIO_MAX_NUMBER))
+        return (-1);
+
+    pthread_mutex_lock(&g_valueLock);
+
+    if (-1 == g_valueFd[gpioNumber])
+    {
+        snprintf(path, sizeof(path), GPIO_SYSFS_PATH "gpio%d/value",
+                 gpioNumber);
+        g_valueFd[gpioNumber] = open(path, O_RDWR | O_CLOEXEC);
+    }
+    fd = g_valueFd[gpioNumber];
+
+    pthread_mutex_unlock(&g_valueLock);
+
+    return (fd);
+}
+
+static void GpioSysfs_close( int gpioNumber )
+{
+    if ((gpioNumber < 0) || (gpioNumber >= GPIO_MAX_NUMBER))
+        return;
+
+    pthread_mutex_lock(&g_valueLock);
+
+    if (-1 != g_valueFd[gpioNumber])
+    {
+        close(g_valueFd[gpioNumber]);
+        g_valueFd[gpioNumber] = -1;
+    }
+
+    pthread_mutex_unlock(&g_valueLock);
+}
+
+static int GpioSysfs_export( int gpioNumber )
+{
+    char number[16];
+
+    if (GpioSysfs_isExported(gpioNumber)) return (GPIO_E_NONE);
+
+    snprintf(number, sizeof(number), "%d", gpioNumber);
+
+    return (GpioSysfs_writeFile(GPIO_SYSFS_PATH "export", number));
+}
+
+static int GpioSysfs_unexport( int gpioNumber )
+{
+    char number[16];
+
+    GpioSysfs_close(gpioNumber);
+
+    if (!GpioSysfs_isExported(gpioNumber)) return (GPIO_E_NONE);
+
+    snprintf(number, sizeof(number), "%d", gpioNumber);
+
+    return (GpioSysfs_writeFile(GPIO_SYSFS_PATH "unexport", number));
+}
+
+static int GpioSysfs_setDirection( int gpioNumber, char * direction )
+{
+    char path[64];
+    int status;
+
+    snprintf(path, sizeof(path), GPIO_SYSFS_PATH "gpio%d/direction",
+             gpioNumber);
+
+    status = GpioSysfs_writeFile(path, direction);
+
+    /* open the value file now, so the first access doesn't pay for it */
+    if ((GPIO_E_NONE == status) && (-1 == GpioSysfs_valueFd(gpioNumber)))
+        status = GPIO_E_OPEN;
+
+    return (status);
+}
+
+static int GpioSysfs_getValue( int gpioNumber, int * value )
+{
+    int fd;
+    char buffer[2];
+
+    fd = GpioSysfs_valueFd(gpioNumber);
+    if (-1 == fd) return (GPIO_E_OPEN);
+
+    if (1 > pread(fd, buffer, sizeof(buffer), 0)) return (GPIO_E_READ);
+
+    *value = buffer[0] - '0';
+
+    return (GPIO_E_NONE);
+}
+
+static int GpioSysfs_setValue( int gpioNumber, int value )
+{
+    int fd;
+
+    fd = GpioSysfs_valueFd(gpioNumber);
+    if (-1 == fd) return (GPIO_E_OPEN);
+
+    if (1 != pwrite(fd, value ? "1" : "0", 1, 0)) return (GPIO_E_WRITE);
+
+    return (GPIO_E_NONE);
+}
+
+
+void GpioSetBackend( int backend )
+{
+    g_backend = backend;
+}
+
+int GpioGetBackend( void )
+{
+    return (g_backend);
+}
+
+void GpioCloseAll( void )
+{
+    int i;
+
+    for (i = 0; i < GPIO_MAX_NUMBER; i++)
+        GpioSysfs_close(i);
+}
 
 int GpioExport( int gpioNumber )
 {
-    return (RunProcessByFormat(GPIO_EXPORT, gpioNumber));
+    if (GPIO_BACKEND_SYSFS == g_backend)
+        return (GpioSysfs_export(gpioNumber));
+
+    /* skip the spawn, returning what the script would for exported pins */
+    if (GpioSysfs_isExported(gpioNumber)) return (W_EXITCODE(1, 0));
+
+    return (RunProcessByFormatCached(&g_scriptExport,
+                                     GPIO_EXPORT, gpioNumber));
 }
 
 int GpioUnexport( int gpioNumber )
 {
-    return (RunProcessByFormat(GPIO_UNEXPORT, gpioNumber));
+    if (GPIO_BACKEND_SYSFS == g_backend)
+        return (GpioSysfs_unexport(gpioNumber));
+
+    GpioSysfs_close(gpioNumber);
+
+    return (RunProcessByFormatCached(&g_scriptUnexport,
+                                     GPIO_UNEXPORT, gpioNumber));
 }
 
 int GpioSetDirection( int gpioNumber, char * direction )
 {
-    return (RunProcessByFormat(GPIO_SET_DIRECTION, gpioNumber, direction));
+    if (GPIO_BACKEND_SYSFS == g_backend)
+        return (GpioSysfs_setDirection(gpioNumber, direction));
+
+    return (RunProcessByFormatCached(&g_scriptSetDirection,
+                                     GPIO_SET_DIRECTION, gpioNumber, direction));
 }
 
 int GpioGetValue( int gpioNumber, int * value )
 {
-    return (RunProcessByFormat(GPIO_GET_VALUE, gpioNumber, value));
+    if (GPIO_BACKEND_SYSFS == g_backend)
+        return (GpioSysfs_getValue(gpioNumber, value));
+
+    return (RunProcessByFormatCached(&g_scriptGetValue,
+                                     GPIO_GET_VALUE, gpioNumber, value));
 }
 
 int GpioSetValue( int gpioNumber, int value )
 {
-    return (RunProcessByFormat(GPIO_SET_VALUE, gpioNumber, value));
+    if (GPIO_BACKEND_SYSFS == g_backend)
+        return (GpioSysfs_setValue(gpioNumber, value));
+
+    return (RunProcessByFormatCached(&g_scriptSetValue,
+                                     GPIO_SET_VALUE, gpioNumber, value));
+}
+
+/* opens the character device of the chip holding gpioNumber */
+static int GpioChip_open( int gpioNumber )
+{
+    char path[32];
+
+    snprintf(path, sizeof(path), GPIO_CHIP_PATH,
+             gpioNumber / GPIO_LINES_PER_CHIP);
+
+    return (open(path, O_RDWR | O_CLOEXEC));
+}
+
+struct GPIO_GROUP * GpioGroupRequest(   const int * gpioNumbers,
+                                        int         nLines,
+                                        int         direction,
+                                        const int * initialValues   )
+{
+    struct gpiohandle_request   request;
+    struct GPIO_GROUP *         group   = NULL;
+    int                         chip;
+    int                         chipFd;
+    int                         i;
+
+    if ((nLines < 1) || (nLines > GPIO_GROUP_MAX_LINES)) return (NULL);
+
+    memset(&request, 0, sizeof(request));
+
+    chip = gpioNumbers[0] / GPIO_LINES_PER_CHIP;
+    for (i = 0; i < nLines; i++)
+    {
+        if (chip != gpioNumbers[i] / GPIO_LINES_PER_CHIP) return (NULL);
+
+        request.lineoffsets[i] = gpioNumbers[i] % GPIO_LINES_PER_CHIP;
+
+        if (NULL != initialValues)
+            request.default_values[i] = !!initialValues[i];
+    }
+
+    request.lines = nLines;
+    request.flags = (GPIO_GROUP_OUTPUT == direction)
+                    ? GPIOHANDLE_REQUEST_OUTPUT
+                    : GPIOHANDLE_REQUEST_INPUT;
+    strncpy(request.consumer_label, GPIO_CONSUMER,
+            sizeof(request.consumer_label) - 1);
+
+    chipFd = GpioChip_open(gpioNumbers[0]);
+    if (-1 == chipFd) return (NULL);
+
+    if (0 == ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &request))
+    {
+        group = malloc(sizeof(struct GPIO_GROUP));
+        if (NULL != group)
+        {
+            group->fd           = request.fd;
+            group->nLines       = nLines;
+            group->direction    = direction;
+        }
+        else
+        {
+            close(request.fd);
+        }
+    }
+
+    /* the line handle stays valid after the chip is closed */
+    close(chipFd);
+
+    return (group);
+}
+
+void GpioGroupRelease( struct GPIO_GROUP * group )
+{
+    if (NULL != group)
+    {
+        close(group->fd);
+        free(group);
+    }
 }
 
+int GpioGroupGetValues( struct GPIO_GROUP * group, int * values )
+{
+    struct gpiohandle_data data;
+    int i;
+
+    if (0 > ioctl(group->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data))
+        return (GPIO_E_IOCTL);
+
+    for (i = 0; i < group->nLines; i++)
+        values[i] = data.values[i];
+
+    return (GPIO_E_NONE);
+}
+
+int GpioGroupSetValues( struct GPIO_GROUP * group, const int * values )
+{
+    struct gpiohandle_data data;
+    int i;
+
+    memset(&data, 0, sizeof(data));
+
+    for (i = 0; i < group->nLines; i++)
+        data.values[i] = !!values[i];
+
+    if (0 > ioctl(group->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data))
+        return (GPIO_E_IOCTL);
+
+    return (GPIO_E_NONE);
+}
+
+int GpioEventRequest( int gpioNumber, int edges )
+{
+    struct gpioevent_request request;
+    int chipFd;
+    int status;
+
+    memset(&request, 0, sizeof(request));
+
+    request.lineoffset  = gpioNumber % GPIO_LINES_PER_CHIP;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags  = edges;
+    strncpy(request.consumer_label, GPIO_CONSUMER,
+            sizeof(request.consumer_label) - 1);
+
+    chipFd = GpioChip_open(gpioNumber);
+    if (-1 == chipFd) return (GPIO_E_OPEN);
+
+    status = ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    close(chipFd);
+
+    if (0 > status) return (GPIO_E_IOCTL);
+
+    return (request.fd);
+}
+
+/* reads one pending edge; level is the line value after the edge */
+int GpioEventRead( int eventFd, uint64_t * timestamp, int * level )
+{
+    struct gpioevent_data event;
+    ssize_t nRead;
+
+    do
+    {
+        nRead = read(eventFd, &event, sizeof(event));
+    } while ((-1 == nRead) && (EINTR == errno));
+
+    if (sizeof(event) != nRead) return (GPIO_E_READ);
+
+    *timestamp  = event.timestamp;
+    *level      = (GPIOEVENT_EVENT_RISING_EDGE == event.id)
+                  ? GPIO_HIGH
+                  : GPIO_LOW;
+
+    return (GPIO_E_NONE);
+}
+
+int GpioEventGetValue( int eventFd, int * value )
+{
+    struct gpiohandle_data data;
+
+    if (0 > ioctl(eventFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data))
+        return (GPIO_E_IOCTL);
+
+    *value = data.values[0];
+
+    return (GPIO_E_NONE);
+}
@@ -10,8 +10,29 @@ Author: Peter Lapets
 Description:
 This file contains declarations of functions used for manipulation of
 general purpose I/O as exposed by the /sys/class/gpio interface.
+
+Two backends are available.  GPIO_BACKEND_SYSFS (the default) accesses
+/sys/class/gpio directly, keeping each pin's value file open after first
+use.  GPIO_BACKEND_SCRIPT calls the scripts in GPIO_PATH, and may be
+selected with GpioSetBackend() where direct access is not permitted.
+
+Lines which change together may instead be requested as a GPIO_GROUP from
+the GPIO character device.  All lines of a group are read or written with
+a single ioctl(), so they never pass through an intermediate state.  Lines
+held by a group cannot also be exported through sysfs.
+
+A single input line may also be requested for edge events with
+GpioEventRequest().  The returned descriptor becomes readable when an edge
+occurs, and may be waited on with poll() or epoll.
 */
 
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
 #include "RunProcessByFormat.h"
 
 
@@ -31,6 +52,55 @@ general purpose I/O as exposed by the /sys/class/gpio interface.
 #define GPIO_GET_VALUE      (GPIO_PATH "gpio-get-value %d:%d"       )
 #define GPIO_SET_VALUE      (GPIO_PATH "gpio-set-value %d %d:"      )
 
+#define GPIO_SYSFS_PATH     "/sys/class/gpio/"
+
+/* AM335x exposes four banks of 32 lines, gpio N is line N%32 of chip N/32 */
+#define GPIO_MAX_NUMBER     (128)
+#define GPIO_LINES_PER_CHIP (32)
+
+#define GPIO_CHIP_PATH      "/dev/gpiochip%d"
+#define GPIO_CONSUMER       "mezzanine"
+#define GPIO_GROUP_MAX_LINES GPIOHANDLES_MAX
+
+enum GPIO_BACKEND
+{
+    GPIO_BACKEND_SCRIPT = 0,
+    GPIO_BACKEND_SYSFS  = 1
+};
+
+enum GPIO_ERROR
+{
+    GPIO_E_NONE         =  0,
+    GPIO_E_RANGE        = -1,
+    GPIO_E_OPEN         = -2,
+    GPIO_E_READ         = -3,
+    GPIO_E_WRITE        = -4,
+    GPIO_E_IOCTL        = -5
+};
+
+enum GPIO_GROUP_DIRECTION
+{
+    GPIO_GROUP_INPUT    = 0,
+    GPIO_GROUP_OUTPUT   = 1
+};
+
+enum GPIO_EDGE
+{
+    GPIO_EDGE_RISING    = GPIOEVENT_REQUEST_RISING_EDGE,
+    GPIO_EDGE_FALLING   = GPIOEVENT_REQUEST_FALLING_EDGE,
+    GPIO_EDGE_BOTH      = GPIOEVENT_REQUEST_BOTH_EDGES
+};
+
+struct GPIO_GROUP
+{
+    int fd;         /* line handle from the GPIO character device   */
+    int nLines;
+    int direction;
+};
+
+void GpioSetBackend ( int backend );
+int  GpioGetBackend ( void );
+void GpioCloseAll   ( void );
 
 int GpioExport      ( int gpioNumber );
 int GpioUnexport    ( int gpioNumber );
@@ -38,5 +108,25 @@ int GpioSetDirection( int gpioNumber, char * direction  );
 int GpioGetValue    ( int gpioNumber, int * value       );
 int GpioSetValue    ( int gpioNumber, int value         );
 
-#endif /* GPIO_H */
+/*  GpioGroupRequest( gpioNumbers , nLines , direction , initialValues )
+ *  All lines must belong to the same chip.  initialValues is only used for
+ *  outputs and may be NULL.  Returns NULL if the lines cannot be requested.
+ */
+struct GPIO_GROUP * GpioGroupRequest    (   const int * gpioNumbers,
+                                            int         nLines,
+                                            int         direction,
+                                            const int * initialValues   );
+void                GpioGroupRelease    ( struct GPIO_GROUP * group );
+int                 GpioGroupGetValues  (   struct GPIO_GROUP * group,
+                                            int *               values  );
+int                 GpioGroupSetValues  (   struct GPIO_GROUP * group,
+                                            const int *         values  );
+
+/*  GpioEventRequest( gpioNumber , edges )
+ *  Returns a pollable event descriptor for the line, or a GPIO_E_ value.
+ */
+int GpioEventRequest    ( int gpioNumber, int edges );
+int GpioEventRead       ( int eventFd, uint64_t * timestamp, int * level );
+int GpioEventGetValue   ( int eventFd, int * value );
 
+#endif /* GPIO_H */
@@ -5,16 +5,199 @@ Date:   2019-02-22
 Author: Peter Lapets
 
 Description:
-This file contains functions used for I2C communication.  These functions 
-are wrappers to calls to RunProcessByFormat(), which call their correspond-
-ing scripts.  These scripts in turn are wrappers for programs from the
-i2c-tools package.
+This file contains functions used for I2C communication.
+
+With I2C_BACKEND_SCRIPT, these functions are wrappers to calls to
+RunProcessByFormatCached(), which call their corresponding scripts.  These
+scripts in turn are wrappers for programs from the i2c-tools package.
+
+With I2C_BACKEND_DEV, the adapter is opened once and kept open.  Register
+reads are SMBus read-word transactions issued through ioctl(), returning
+the same raw value i2cget would print.
+
+Every public function holds g_busLock, so the descriptor and slave address
+caches (and the script template) are safe to use from several threads,
+e.g. the temperature sampler and init.
 */
 
 #include "i2c.h"
 
+static int g_backend = I2C_BACKEND_DEV;
+
+static pthread_mutex_t g_busLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* cached adapter descriptors and selected slave address per bus */
+static int           g_busFd[I2C_MAX_BUS]     = { [0 ... I2C_MAX_BUS - 1] = -1 };
+static int           g_busAddr[I2C_MAX_BUS]   = { [0 ... I2C_MAX_BUS - 1] = -1 };
+static unsigned long g_busFuncs[I2C_MAX_BUS];
+
+/* script argv template, compiled on first use */
+static struct RPBF_TEMPLATE * g_scriptReadRegister = NULL;
+
+
+/* returns the adapter descriptor for a bus, addressed to addr */
+static int I2cDev_select( int bus, int addr )
+{
+    char path[32];
+    int fd;
+
+    if ((bus < 0) || (bus >= I2C_MAX_BUS)) return (I2C_E_RANGE);
+
+    if (-1 == g_busFd[bus])
+    {
+        snprintf(path, sizeof(path), I2C_DEV_PATH, bus);
+
+        fd = open(path, O_RDWR | O_CLOEXEC);
+        if (-1 == fd) return (I2C_E_OPEN);
+
+        if (0 > ioctl(fd, I2C_FUNCS, &g_busFuncs[bus]))
+            g_busFuncs[bus] = 0;
+
+        g_busFd[bus]   = fd;
+        g_busAddr[bus] = -1;
+    }
+
+    if (addr != g_busAddr[bus])
+    {
+        if (0 > ioctl(g_busFd[bus], I2C_SLAVE, addr)) return (I2C_E_ADDRESS);
+        g_busAddr[bus] = addr;
+    }
+
+    return (g_busFd[bus]);
+}
+
+static int I2cDev_readWord( int bus, int addr, int reg, int * val )
+{
+    union i2c_smbus_data data;
+    struct i2c_smbus_ioctl_data args;
+    int fd;
+
+    fd = I2cDev_select(bus, addr);
+    if (0 > fd) return (fd);
+
+    args.read_write = I2C_SMBUS_READ;
+    args.command    = reg;
+    args.size       = I2C_SMBUS_WORD_DATA;
+    args.data       = &data;
+
+    if (0 > ioctl(fd, I2C_SMBUS, &args)) return (I2C_E_TRANSFER);
+
+    *val = data.word;
+
+    return (I2C_E_NONE);
+}
+
+static int I2cDev_readWordPair( int bus, int addr,
+                                int reg0, int reg1,
+                                int * val0, int * val1  )
+{
+    struct i2c_msg msgs[4];
+    struct i2c_rdwr_ioctl_data transfer;
+    uint8_t command[2];
+    uint8_t word[2][2];
+    int fd;
+    int status;
+
+    fd = I2cDev_select(bus, addr);
+    if (0 > fd) return (fd);
+
+    /* adapter cannot do combined transfers: fall back to two reads */
+    if (0 == (g_busFuncs[bus] & I2C_FUNC_I2C))
+    {
+        status = I2cDev_readWord(bus, addr, reg0, val0);
+        if (I2C_E_NONE == status)
+            status = I2cDev_readWord(bus, addr, reg1, val1);
+
+        return (status);
+    }
+
+    command[0] = reg0;
+    command[1] = reg1;
+
+    /* write command, repeated start, read LSB/MSB; for each register */
+    msgs[0] = (struct i2c_msg) { addr, 0,        1, &command[0] };
+    msgs[1] = (struct i2c_msg) { addr, I2C_M_RD, 2, word[0]     };
+    msgs[2] = (struct i2c_msg) { addr, 0,        1, &command[1] };
+    msgs[3] = (struct i2c_msg) { addr, I2C_M_RD, 2, word[1]     };
+
+    transfer.msgs  = msgs;
+    transfer.nmsgs = 4;
+
+    if (0 > ioctl(fd, I2C_RDWR, &transfer)) return (I2C_E_TRANSFER);
+
+    *val0 = word[0][0] | (word[0][1] << 8);
+    *val1 = word[1][0] | (word[1][1] << 8);
+
+    return (I2C_E_NONE);
+}
+
+
+void I2cSetBackend( int backend )
+{
+    g_backend = backend;
+}
+
+int I2cGetBackend( void )
+{
+    return (g_backend);
+}
+
+void I2cCloseAll( void )
+{
+    int i;
+
+    pthread_mutex_lock(&g_busLock);
+
+    for (i = 0; i < I2C_MAX_BUS; i++)
+    {
+        if (-1 != g_busFd[i]) close(g_busFd[i]);
+
+        g_busFd[i]   = -1;
+        g_busAddr[i] = -1;
+    }
+
+    pthread_mutex_unlock(&g_busLock);
+}
+
 int I2cReadRegister( int bus, int addr, int reg, int * val )
 {
-    return (RunProcessByFormat(I2C_READ_REGISTER, bus, addr, reg, val));
+    int status;
+
+    pthread_mutex_lock(&g_busLock);
+
+    if (I2C_BACKEND_DEV == g_backend)
+        status = I2cDev_readWord(bus, addr, reg, val);
+    else
+        status = RunProcessByFormatCached(&g_scriptReadRegister,
+                                          I2C_READ_REGISTER, bus, addr, reg, val);
+
+    pthread_mutex_unlock(&g_busLock);
+
+    return (status);
 }
 
+int I2cReadRegisterPair(    int bus, int addr,
+                            int reg0, int reg1,
+                            int * val0, int * val1  )
+{
+    int status;
+
+    pthread_mutex_lock(&g_busLock);
+
+    if (I2C_BACKEND_DEV == g_backend)
+    {
+        status = I2cDev_readWordPair(bus, addr, reg0, reg1, val0, val1);
+    }
+    else
+    {
+        status = RunProcessByFormatCached(&g_scriptReadRegister,
+                                          I2C_READ_REGISTER, bus, addr, reg0, val0);
+        if (0 == status)
+            status = RunProcessByFormatCached(&g_scriptReadRegister,
+                                              I2C_READ_REGISTER, bus, addr, reg1, val1);
+    }
+
+    pthread_mutex_unlock(&g_busLock);
+
+    return (status);
+}
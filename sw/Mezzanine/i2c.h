@@ -9,8 +9,20 @@ Author: Peter Lapets
 
 Description:
 This file contains function declarations used for I2C communication.
+
+Two backends are available.  I2C_BACKEND_DEV (the default) holds the
+/dev/i2c-N adapter open and issues SMBus transfers through ioctl().
+I2C_BACKEND_SCRIPT calls the scripts in I2C_PATH, and may be selected with
+I2cSetBackend() where direct access is not permitted.
 */
 
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
 #include "RunProcessByFormat.h"
 
 
@@ -18,7 +30,36 @@ This file contains function declarations used for I2C communication.
 
 #define I2C_READ_REGISTER (I2C_PATH "i2c-read-register %d %#x %#x:%x")
 
-int I2cReadRegister( int bus, int addr, int reg, int * val );
+#define I2C_DEV_PATH    "/dev/i2c-%d"
+#define I2C_MAX_BUS     (8)
 
-#endif /* I2C_H */
+enum I2C_BACKEND
+{
+    I2C_BACKEND_SCRIPT  = 0,
+    I2C_BACKEND_DEV     = 1
+};
+
+enum I2C_ERROR
+{
+    I2C_E_NONE          =  0,
+    I2C_E_RANGE         = -1,
+    I2C_E_OPEN          = -2,
+    I2C_E_ADDRESS       = -3,
+    I2C_E_TRANSFER      = -4
+};
 
+void I2cSetBackend  ( int backend );
+int  I2cGetBackend  ( void );
+void I2cCloseAll    ( void );
+
+int I2cReadRegister     ( int bus, int addr, int reg, int * val );
+
+/*  I2cReadRegisterPair( bus, addr, reg0, reg1, val0, val1 )
+ *  Reads two word registers from the same device.  With I2C_BACKEND_DEV,
+ *  both reads are issued as a single combined transfer.
+ */
+int I2cReadRegisterPair (   int bus, int addr,
+                            int reg0, int reg1,
+                            int * val0, int * val1  );
+
+#endif /* I2C_H */
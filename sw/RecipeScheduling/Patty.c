@@ -37,6 +37,8 @@ struct Patty * Patty_new( gint _x, gint _y )
     _patty->x = _x;
     _patty->y = _y;
     _patty->temp = 0.0;
+    _patty->tempTime = 0;
+    _patty->planner = NULL;
 
     return (_patty);
 }
@@ -85,25 +87,168 @@ void Patty_replaceWithNearest( struct Patty * patty, GSList * pattyList )
     patty->y = tempPatty.y;
 }
 
+/*  Patty_probeTemperature( patty )
+ *  Call while the probe is at the patty.  Runs the temperature sampler for
+ *  the dwell only, and sets the patty's temperature to the median of up to
+ *  PATTY_TEMP_SAMPLES samples taken after the call.  The temperature is left
+ *  alone if none arrive within PATTY_TEMP_TIMEOUT_US.
+ */
+static gboolean Patty_probeTemperature( struct Patty * patty )
+{
+    uint64_t    first;
+    uint64_t    nSamples;
+    gint64      deadline;
+    gboolean    result = FALSE;
+
+    if (TEMP_SAMPLER_E_NONE != TempSampler_start(TEMP_SAMPLER_RATE_HZ))
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Could not start the temperature sampler.\n");
+        return (FALSE);
+    }
+
+    // only samples taken from here on were taken at this patty
+    first    = TempSampler_getSampleCount();
+    deadline = g_get_monotonic_time() + PATTY_TEMP_TIMEOUT_US;
+
+    do
+    {
+        usleep((useconds_t) (1e6 / TEMP_SAMPLER_RATE_HZ));
+        nSamples = TempSampler_getSampleCount() - first;
+    } while ((nSamples < PATTY_TEMP_SAMPLES) && (g_get_monotonic_time() < deadline));
+
+    if (nSamples > PATTY_TEMP_SAMPLES) nSamples = PATTY_TEMP_SAMPLES;
+
+    if (    (nSamples > 0)
+        &&  (TEMP_SAMPLER_E_NONE == TempSampler_getMedian((int) nSamples, &(patty->temp)))   )
+    {
+        patty->tempTime = g_get_monotonic_time();
+        result = TRUE;
+    }
+
+    TempSampler_stop();
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+    if (result)
+        fprintf(G_SYSTEM_LOG,   "Mezzanine: Got patty temperature at (%d, %d): %lf "
+                                "(median of %d)\n",
+                                patty->x, patty->y, patty->temp, (int) nSamples);
+    else
+        fprintf(G_SYSTEM_LOG,   "Mezzanine: No temperature at (%d, %d) "
+                                "(%lu flagged, %lu failed reads so far).\n",
+                                patty->x, patty->y,
+                                (unsigned long) TempSampler_getFlaggedCount(),
+                                (unsigned long) TempSampler_getErrorCount());
+
+    return (result);
+}
+
+static void Patty_onDwell( int index, gpointer sweepOrder )
+{
+    Patty_probeTemperature(((struct Patty **) sweepOrder)[index]);
+}
+
+/*  Patty_sweepTemperatures( planner, pattyList )
+ *  Measures the temperature of every patty in the list in as few robot trips
+ *  as possible: one sweep per RCTL_SWEEP_MAX_WAYPOINTS patties, instead of a
+ *  trip from home and back for each.  The patties are visited in
+ *  nearest-neighbour order starting from the origin.  If the robot program
+ *  cannot sweep, or a sweep fails, nothing (more) is measured here and
+ *  Patty_isDone() probes each remaining patty on its own.
+ */
+void Patty_sweepTemperatures( struct MOTION_PLANNER * planner, GSList * pattyList )
+{
+    struct Patty *          order[RCTL_SWEEP_MAX_WAYPOINTS];
+    struct ROBOT_POSE_3D    waypoints[RCTL_SWEEP_MAX_WAYPOINTS];
+    struct Patty            here = { 0, 0, 0.0, 0, NULL };
+    GSList *                remaining;
+    GSList *                nearest;
+    GSList *                link;
+    gint                    nWaypoints;
+    int                     status;
+
+    if (NULL == pattyList) return;
+
+    if (!RobotControl_CanSweep(MotionPlanner_GetRobot(planner)))
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Robot cannot sweep; probing patties one at a time.\n");
+        return;
+    }
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+    fprintf(G_SYSTEM_LOG,   "Performing temperature sweep of %d patties.\n",
+                            g_slist_length(pattyList));
+    DEBUG_PRINT_LEVEL_ENTER();
+
+    remaining = g_slist_copy(pattyList);
+    MotionPlanner_Home(planner);
+
+    while (NULL != remaining)
+    {
+        for (nWaypoints = 0;
+             (NULL != remaining) && (nWaypoints < RCTL_SWEEP_MAX_WAYPOINTS);
+             nWaypoints++)
+        {
+            nearest = remaining;
+            for (link = remaining->next; NULL != link; link = link->next)
+            {
+                if (    Patty_distanceBetween_fast(&here, link->data)
+                    <   Patty_distanceBetween_fast(&here, nearest->data)    )
+                {
+                    nearest = link;
+                }
+            }
+
+            order[nWaypoints] = nearest->data;
+            waypoints[nWaypoints].x = order[nWaypoints]->x;
+            waypoints[nWaypoints].y = order[nWaypoints]->y;
+            waypoints[nWaypoints].z = 0;
+
+            here.x = order[nWaypoints]->x;
+            here.y = order[nWaypoints]->y;
+            remaining = g_slist_delete_link(remaining, nearest);
+        }
+
+        status = MotionPlanner_Sweep(planner, waypoints, nWaypoints, Patty_onDwell, order);
+        if (RCTL_E_NO_ERROR != status)
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+            fprintf(G_SYSTEM_LOG,   "Temperature sweep failed (%d); "
+                                    "probing the rest one at a time.\n", status);
+            g_slist_free(remaining);
+            break;
+        }
+    }
+
+    MotionPlanner_Home(planner);
+    DEBUG_PRINT_LEVEL_EXIT();
+}
+
 gboolean Patty_isDone( struct Patty * patty )
 {
     struct ROBOT_POSE_3D pose = { 0, 0, 0 };
     gboolean isDone;
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Performing patty done check.\n");
-    RobotControl_Home();
 
-    pose.x = patty->x;
-    pose.y = patty->y;
+    if (    (0 != patty->tempTime)
+        &&  (g_get_monotonic_time() - patty->tempTime < PATTY_TEMP_MAX_AGE_US)   )
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+        fprintf(G_SYSTEM_LOG, "Using swept patty temperature: %lf\n", patty->temp);
+    }
+    else
+    {
+        MotionPlanner_Home(patty->planner);
 
-    RobotControl_Temp(&pose);
-    Mezzanine_TempSensorGetTObject(&(patty->temp));
-    RobotControl_Home();
+        pose.x = patty->x;
+        pose.y = patty->y;
 
-    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
-    fprintf(G_SYSTEM_LOG, "Mezzanine: Got patty temperature: %lf\n", patty->temp);
+        MotionPlanner_Temp(patty->planner, &pose);
+        Patty_probeTemperature(patty);
+        MotionPlanner_Home(patty->planner);
+    }
 
-    isDone = (patty->temp > 27.0);
+    isDone = (patty->temp > PATTY_DONE_TEMP);
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
     fprintf(G_SYSTEM_LOG, "Patty is %sdone.\n", isDone ? "" : "not ");
@@ -118,22 +263,27 @@ void Patty_actionFlip( struct Patty * patty )
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Performing patty flip.\n");
 
-    RobotControl_Home();
+    MotionPlanner_Home(patty->planner);
 
     pose.x = patty->x;
     pose.y = patty->y;
 
-    RobotControl_Flip(&pose);
+    MotionPlanner_Flip(patty->planner, &pose);
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Updating patty location.\n");
 
     //PattyFactory_setBackProjFromFile("./im/h15-bi.jpg");
 
-    RobotControl_Home();
-    RobotControl_Photo();
-    PattyFactory_updateFrame();
+    MotionPlanner_Home(patty->planner);
+    MotionPlanner_Photo(patty->planner);
+    if (!PattyFactory_updateFrame())
+    {
+        MotionPlanner_Home(patty->planner);
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "No camera frame; keeping the last patty location.\n");
+        return;
+    }
     PattyFactory_setBackProjFromCam();
-    RobotControl_Home();
+    MotionPlanner_Home(patty->planner);
 
     pattyList = PattyFactory_getPattyList(BACK_PROJECT);
 
@@ -162,17 +312,18 @@ void Patty_actionRemove( struct Patty * patty )
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Performing patty remove.\n");
 
-    RobotControl_Home();
+    MotionPlanner_Home(patty->planner);
 
     pose.x = patty->x;
     pose.y = patty->y;
 
-    RobotControl_Deposit(&pose);
-    RobotControl_Home();
+    MotionPlanner_Deposit(patty->planner, &pose);
+    MotionPlanner_Home(patty->planner);
+
+    /* park the robot clear of the conveyor before it moves */
+    MotionPlanner_Settle(patty->planner);
 
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Advancing conveyor.\n");
-    Mezzanine_ConveyorSetState(CONVEYOR_FORWARD);
-    sleep(3);
-    Mezzanine_ConveyorSetState(CONVEYOR_STOPPED);
+    Mezzanine_ConveyorRunFor(CONVEYOR_FORWARD, PATTY_CONVEYOR_ADVANCE_MS);
 }
 
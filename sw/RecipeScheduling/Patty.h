@@ -17,20 +17,41 @@ data structure, as well as the Patty base recipe.
 
 #include <stdio.h>
 #include <stdlib.h> /* abs() */
-#include <unistd.h> /* sleep() */
+#include <unistd.h> /* sleep(), usleep() */
 #include <glib.h>
 
 #include "Recipe.h"
 #include "PattyFactory.hpp"
 
 #include "../Mezzanine/Mezzanine.h"
+#include "../Mezzanine/TempSampler.h"
 #include "../RobotControl/RobotControl.h"
+#include "../RobotControl/MotionPlanner.h"
+
+/* how long to run the conveyor after depositing a patty */
+#define PATTY_CONVEYOR_ADVANCE_MS   3000
+
+/* a patty is done once its surface is hotter than this */
+#define PATTY_DONE_TEMP             27.0
+
+/* a temperature from a sweep is used by Patty_isDone for this long */
+#define PATTY_TEMP_MAX_AGE_US       (20 * G_USEC_PER_SEC)
+
+/* each probe reading is the median of this many samples taken at the patty,
+   waiting at most PATTY_TEMP_TIMEOUT_US for them */
+#define PATTY_TEMP_SAMPLES          5
+#define PATTY_TEMP_TIMEOUT_US       (2 * G_USEC_PER_SEC)
 
 struct Patty
 {
     gint    x;
     gint    y;
     gdouble temp;
+    gint64  tempTime;   /* g_get_monotonic_time() of temp; 0 if never */
+
+    /* planner for the robot serving this patty's grill; set when its recipe
+       is built by RecipeList_buildFromPattyList() */
+    struct MOTION_PLANNER * planner;
 };
 
 
@@ -42,6 +63,9 @@ struct Patty *  Patty_new       ( gint _x, gint _y );
 void            Patty_replaceWithNearest(   struct Patty *  patty,
                                             GSList *        pattyList   );
 
+void            Patty_sweepTemperatures(    struct MOTION_PLANNER * planner,
+                                            GSList *                pattyList   );
+
 gboolean        Patty_isDone    (   struct Patty * patty      );
 void            Patty_actionFlip(   struct Patty * patty      );
 void            Patty_actionRemove( struct Patty * patty      );
@@ -0,0 +1,118 @@
+/*
+File:   PattyBench.cpp
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements a stand-alone command-line driver for the image
+processing self-checks and benchmarks in PattyFactory.cpp, so they can be
+run on the target against recorded camera images without the robot, the
+mezzanine or the recipe scheduler.
+
+    PattyBench [-n iterations] blur bg.jpg fg.jpg
+    PattyBench [-n iterations] decimation bg.jpg fg.jpg
+
+run PattyFactory_benchmarkBlur() and PattyFactory_benchmarkDecimation() on
+a recorded background/foreground pair, printing each blur mode's time and
+error against the exact Gaussian, and each decimation level's time and
+centroid error against full resolution.
+
+    PattyBench [-n iterations] backproject frame.jpg
+
+runs PattyFactory_checkBackProject(): the one-pass back projection this
+build uses (NEON, AVX2 or scalar) is checked against cvtColor +
+calcBackProject on every BGR triple, then both are timed on the frame.
+
+Build and run on the target, e.g.:
+
+    gcc -std=gnu99 -O2 -c Patty.c Recipe.c RecipeStep.c \
+        ../RobotControl/RobotControl.c ../RobotControl/MotionPlanner.c \
+        ../Mezzanine/Mezzanine.c ../Mezzanine/TempSampler.c \
+        ../Mezzanine/gpio.c ../Mezzanine/i2c.c ../Mezzanine/ProcessHelper.c \
+        ../Mezzanine/RunProcessByFormat.c ../DEBUG_PRINT.c ../Histogram.c \
+        `pkg-config --cflags glib-2.0`
+    g++ -std=c++11 -O2 -o PattyBench PattyBench.cpp PattyFactory.cpp *.o \
+        `pkg-config --cflags --libs opencv glib-2.0` -lmodbus -lpthread
+    ./PattyBench -n 50 blur ./im/bg.jpg ./im/fg.jpg
+
+The exit status is EXIT_FAILURE if an image could not be read, or if the
+back projection check found a pixel that differs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "PattyFactory.hpp"
+
+#define PATTY_BENCH_DEFAULT_ITERATIONS  20
+
+FILE * G_SYSTEM_LOG;
+
+
+static void PattyBench_usage( const char * name )
+{
+    fprintf(stderr,
+            "usage: %s [options] test files...\n"
+            "    -n iterations       runs per timed case (default %d)\n"
+            "tests:\n"
+            "    blur bg fg          blur modes against the exact Gaussian\n"
+            "    decimation bg fg    decimation levels against full resolution\n"
+            "    backproject frame   one-pass back projection against OpenCV\n",
+            name, PATTY_BENCH_DEFAULT_ITERATIONS);
+}
+
+int main( int argc, char ** argv )
+{
+    const char *    test;
+    gint            iterations = PATTY_BENCH_DEFAULT_ITERATIONS;
+    gboolean        result;
+    int             nFiles;
+    int             option;
+
+    G_SYSTEM_LOG = stderr;
+
+    while (-1 != (option = getopt(argc, argv, "n:h")))
+    {
+        switch (option)
+        {
+            case 'n': iterations = (gint) strtol(optarg, NULL, 0); break;
+            default:
+                PattyBench_usage(argv[0]);
+                return (EXIT_FAILURE);
+        }
+    }
+
+    if ((optind >= argc) || (iterations < 1))
+    {
+        PattyBench_usage(argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    test   = argv[optind];
+    nFiles = argc - optind - 1;
+
+    if ((0 == strcmp(test, "blur")) && (2 == nFiles))
+    {
+        result = PattyFactory_benchmarkBlur(argv[optind + 1], argv[optind + 2],
+                                            iterations, stdout);
+    }
+    else if ((0 == strcmp(test, "decimation")) && (2 == nFiles))
+    {
+        result = PattyFactory_benchmarkDecimation(  argv[optind + 1], argv[optind + 2],
+                                                    iterations, stdout);
+    }
+    else if ((0 == strcmp(test, "backproject")) && (1 == nFiles))
+    {
+        result = PattyFactory_checkBackProject(argv[optind + 1], iterations, stdout);
+    }
+    else
+    {
+        PattyBench_usage(argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -1,16 +1,74 @@
 
 #include "PattyFactory.hpp"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
 
 using namespace cv;
 
 static VideoCapture g_cam;
 
 static Mat g_current_frame;
+static gint64 g_current_frame_time = 0;
+
+/* Triple buffer filled by the capture thread.  The thread reads into
+   g_frames[g_back] and then swaps it with g_middle; updateFrame swaps
+   g_middle with g_front.  Only the capture thread touches g_back and only
+   updateFrame touches g_front, so handing a frame over never copies it;
+   updateFrame copies the front frame out once, into g_current_frame.  The
+   indices themselves change only under g_frameLock.
+
+   g_frameTimes is the driver's timestamp of each frame where it has one
+   (V4L2 reports the buffer's CLOCK_MONOTONIC time as CAP_PROP_POS_MSEC),
+   else the time read() returned.  Either may be later than the exposure,
+   so g_frameNotBefore holds the time of the previous frame, which the
+   exposure cannot have started before. */
+static Mat                      g_frames[3];
+static gint64                   g_frameTimes[3];
+static gint64                   g_frameNotBefore[3];
+static int                      g_front     = 0;
+static int                      g_middle    = 1;
+static int                      g_back      = 2;
+static bool                     g_fresh     = false;    /* middle is unread */
+static std::mutex               g_frameLock;
+static std::condition_variable  g_frameReady;
+static std::atomic<bool>        g_capturing(false);
+static std::thread              g_captureThread;
+
+/* stage timing; g_stageNs holds the current frame's times for the log */
+static struct HISTOGRAM_WINDOW  g_stageTimes[PATTY_STAGE_COUNT];
+static uint64_t                 g_stageNs[PATTY_STAGE_COUNT];
+static bool                     g_timingLog = false;
+static std::mutex               g_timingLock;
+
+static const char * const g_stageNames[PATTY_STAGE_COUNT] =
+{
+    "capture",
+    "decimate",
+    "hue",
+    "back project",
+    "absdiff",
+    "blur",
+    "threshold",
+    "contours",
+    "draw"
+};
 
 static Mat g_bg;
 static Mat g_fg;
 
+/* g_bg at the detection scale, rebuilt when either changes */
+static Mat g_bgDecimated;
+static int g_bgDecimatedLevels = -1;
+
 static Mat g_src;
 
 static MatND            g_hist;
@@ -21,57 +79,165 @@ static const float *    g_ranges = { HUE_RANGES };
 static Mat g_ui_pre;
 static Mat g_ui_post;
 
-static bool PattyFactory_decimateMatFromFile( Mat & dst, const gchar * filename )
+static enum BLUR_MODE   g_blurMode = BG_SUBTRACT_BLUR_MODE;
+static int              g_decimation = DECIMATION_LEVELS;
+
+static uint64_t PattyFactory_now( void )
+{
+    return (std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* charge the time since start to stage */
+static void PattyFactory_stageEnd( enum PATTY_FACTORY_STAGE stage, uint64_t start )
+{
+    uint64_t elapsed = PattyFactory_now() - start;
+
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    g_stageNs[stage] += elapsed;
+}
+
+/* record a stage which runs per call rather than once per detection frame,
+   straight into its rolling window */
+static void PattyFactory_stageRecord( enum PATTY_FACTORY_STAGE stage, uint64_t start )
+{
+    uint64_t elapsed = PattyFactory_now() - start;
+
+    std::lock_guard<std::mutex> lock(g_timingLock);
+
+    if (0 == g_stageTimes[stage].samplesPerSlot)
+        Histogram_windowInit(&g_stageTimes[stage], PATTY_FACTORY_TIMING_SLOT_FRAMES);
+
+    Histogram_windowRecord(&g_stageTimes[stage], elapsed);
+
+    if (g_timingLog)
+        DEBUG_PRINT_LEVEL_FORMAT(G_SYSTEM_LOG, "PattyFactory: %s %.2f ms\n",
+                                 g_stageNames[stage], elapsed * 1e-6);
+}
+
+/* close the current frame: fold its stage times into the rolling window */
+static void PattyFactory_frameEnd( void )
 {
-    Mat         src;
-    bool        succeeded   = false;
-    std::string fname       = std::string(filename);
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    int stage;
 
-    src = imread(fname);
-    succeeded = (false == src.empty());
+    if (g_timingLog)
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, (char *) "PattyFactory: frame (ms):");
+        for (stage = 0; stage < PATTY_STAGE_COUNT; stage++)
+        {
+            if (0 != g_stageNs[stage])
+                fprintf(G_SYSTEM_LOG, " %s %.2f", g_stageNames[stage], g_stageNs[stage] * 1e-6);
+        }
+        fprintf(G_SYSTEM_LOG, "\n");
+    }
 
-    if (succeeded)
+    for (stage = 0; stage < PATTY_STAGE_COUNT; stage++)
     {
-        resize(src, dst, Size(), DECIMATION_FACTOR, DECIMATION_FACTOR,
-                INTER_NEAREST);
+        if (0 == g_stageTimes[stage].samplesPerSlot)
+            Histogram_windowInit(&g_stageTimes[stage], PATTY_FACTORY_TIMING_SLOT_FRAMES);
+
+        /* stages the method did not use are not counted as zero */
+        if (0 != g_stageNs[stage])
+            Histogram_windowRecord(&g_stageTimes[stage], g_stageNs[stage]);
+
+        g_stageNs[stage] = 0;
     }
+}
 
-    return (succeeded);
+static bool PattyFactory_matFromFile( Mat & dst, const gchar * filename )
+{
+    dst = imread(std::string(filename));
+
+    return (false == dst.empty());
 }
 
-static GSList * PattyFactory_getPattyListFromBlobs( Mat & binary )
+/* src pyrDown'd levels times; shares src's data when levels is 0 */
+static Mat PattyFactory_decimate( const Mat & src, int levels )
+{
+    Mat dst = src;
+    int i;
+
+    for (i = 0; i < levels; i++)
+        pyrDown(dst, dst);
+
+    return (dst);
+}
+
+/* Each pyrDown already blurs with variance 1 at its input scale, which is
+   (4^levels - 1) / 3 full-resolution pixels^2 over levels steps.  Returns
+   the sigma, in decimated pixels, that makes up the rest of a blur of sigma
+   full-resolution pixels. */
+static double PattyFactory_decimatedSigma( double sigma, int levels )
+{
+    double pyramidVar = ((1 << (2 * levels)) - 1) / 3.0;
+
+    if (sigma * sigma <= pyramidVar) return (0.0);
+
+    return (std::sqrt(sigma * sigma - pyramidVar) / (1 << levels));
+}
+
+/* bounding box of each blob in binary */
+static void PattyFactory_findBlobs( Mat & binary, std::vector<Rect> & boxes )
 {
-    GSList * pattyList = NULL;
     std::vector<std::vector<Point> > contours;
-    int xOffset = binary.rows / 2;
-    int yOffset = binary.cols / 2;
 
-    // find contours of the objects
-    puts("        find contours");
     findContours( binary, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    printf("        contour size: %d\n", contours.size());
 
-    // find a bounding box for each found object
+    boxes.clear();
     for ( size_t i = 0; i < contours.size(); ++i )
+        boxes.push_back(boundingRect( Mat(contours[i]) ));
+}
+
+/* Centre of a blob's bounding box in full-resolution pixels.  Pixel i of
+   a pyrDown'd image is centred on pixel 2i of its input, so box centres
+   scale by 2^levels exactly. */
+static Point2d PattyFactory_blobCenter( const Rect & bb, int levels )
+{
+    double scale = (double) (1 << levels);
+
+    return (Point2d(    (bb.x + (bb.width  - 1) / 2.0) * scale,
+                        (bb.y + (bb.height - 1) / 2.0) * scale  ));
+}
+
+/* binary is at 1 / 2^levels of full, the size of the camera image */
+static GSList * PattyFactory_getPattyListFromBlobs( Mat & binary, int levels, Size full )
+{
+    GSList * pattyList = NULL;
+    std::vector<Rect> boxes;
+    int xOffset = full.width / 2;
+    int yOffset = full.height / 2;
+    uint64_t start;
+
+    // find a bounding box for each found object
+    start = PattyFactory_now();
+    PattyFactory_findBlobs(binary, boxes);
+
+    for ( size_t i = 0; i < boxes.size(); ++i )
+    {
+        Point2d center = PattyFactory_blobCenter(boxes[i], levels);
+
+        Patty * foundPatty = Patty_new( (gint) std::lround((center.x - xOffset) * MM_PER / PX_PER),
+                                        (gint) std::lround((center.y - yOffset) * MM_PER / PX_PER)  );
+
+        pattyList = g_slist_prepend(pattyList, foundPatty);
+    }
+    PattyFactory_stageEnd(PATTY_STAGE_CONTOURS, start);
+
+    // mark the blobs on the blob image, at its scale
+    start = PattyFactory_now();
+    for ( size_t i = 0; i < boxes.size(); ++i )
     {
-        puts("        get bounding rect and center point");
-        Rect bb = boundingRect( Mat(contours[i]) );
+        Rect bb = boxes[i];
         Point center = Point(   bb.x + bb.width / 2,
                                 bb.y + bb.height / 2 );
 
-        puts("        draw rect and markers");
         rectangle(g_ui_post, bb.tl(), bb.br(), Scalar(0, 255, 0), 4);
         drawMarker(g_ui_post,   center,
                                 Scalar(255, 0, 255),
                                 MARKER_TILTED_CROSS, 16, 2  );
-
-        puts("        make patty");
-        Patty * foundPatty = Patty_new((center.x - xOffset) * MM_PER / PX_PER,
-                                       (center.y - yOffset) * MM_PER / PX_PER);
-
-        puts("        add to pattylist");
-        pattyList = g_slist_prepend(pattyList, foundPatty);
     }
+    PattyFactory_stageEnd(PATTY_STAGE_DRAW, start);
 
     return (pattyList);
 }
@@ -92,6 +258,59 @@ static Mat PattyFactory_hueFromRgb(Mat & rgb)
     return (hue);
 }
 
+static void PattyFactory_captureLoop( void )
+{
+    gint64 returned;
+    gint64 driver;
+    gint64 captured;
+    gint64 previous = 0;
+
+    while (g_capturing)
+    {
+        if (!g_cam.read(g_frames[g_back]))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        returned = g_get_monotonic_time();
+
+        // other backends report a stream position here, which fails this
+        driver = (gint64) (g_cam.get(CAP_PROP_POS_MSEC) * 1000.0);
+        captured = ((driver > 0) && (driver <= returned)
+                    && (returned - driver < PATTY_FACTORY_FRAME_TIMEOUT_MS * 1000))
+                   ? driver
+                   : returned;
+
+        {
+            std::lock_guard<std::mutex> lock(g_frameLock);
+            g_frameTimes[g_back]     = captured;
+            g_frameNotBefore[g_back] = previous;
+            std::swap(g_back, g_middle);
+            g_fresh = true;
+        }
+        g_frameReady.notify_all();
+
+        previous = captured;
+    }
+}
+
+static void PattyFactory_stopCapture( void )
+{
+    if (g_captureThread.joinable())
+    {
+        g_capturing = false;
+        g_captureThread.join();
+    }
+}
+
+/* stops the capture thread at exit if PattyFactory_shdn() was not called;
+   declared after the thread so that it is destroyed first */
+static struct PattyFactory_captureGuard
+{
+    ~PattyFactory_captureGuard() { PattyFactory_stopCapture(); }
+} g_captureGuard;
+
 /* initializes the camera interface, etc. */
 int PattyFactory_init( void )
 {
@@ -100,39 +319,99 @@ int PattyFactory_init( void )
     if (!g_cam.isOpened())  // check if we succeeded
         return -1;
 
+    // keep the driver's own queue as short as it allows
+    g_cam.set(CAP_PROP_BUFFERSIZE, 1);
+
+    g_capturing = true;
+    g_captureThread = std::thread(PattyFactory_captureLoop);
+
     return (0);
 }
 
-/* loads the background image from the provided filename with decimation */
+void PattyFactory_shdn( void )
+{
+    PattyFactory_stopCapture();
+    g_cam.release();
+}
+
+/* loads the background image from the provided filename */
 void PattyFactory_setBgFromFile( const gchar * filename )
 {
-    PattyFactory_decimateMatFromFile(g_bg, filename);
+    PattyFactory_matFromFile(g_bg, filename);
+    g_bgDecimatedLevels = -1;
 }
 
-/* loads the foreground image from the provided filename with decimation */
+/* loads the foreground image from the provided filename */
 void PattyFactory_setFgFromFile( const gchar * filename )
 {
-    PattyFactory_decimateMatFromFile(g_fg, filename);
+    PattyFactory_matFromFile(g_fg, filename);
 }
 
-/* loads the back-projection source from the provided filename with decimation */
+/* loads the back-projection source from the provided filename */
 void PattyFactory_setBackProjFromFile( const gchar * filename )
 {
-    PattyFactory_decimateMatFromFile(g_src, filename);
+    PattyFactory_matFromFile(g_src, filename);
 }
 
-void PattyFactory_updateFrame( void )
+gboolean PattyFactory_updateFrame( void )
 {
+    gint64 requested = g_get_monotonic_time();
+    gint64 captured;
+    uint64_t start = PattyFactory_now();
     Mat temp;
-    
-    g_cam >> temp;
-    resize(temp, g_current_frame, Size(), DECIMATION_FACTOR, DECIMATION_FACTOR,
-            INTER_NEAREST);
+
+    if (!g_captureThread.joinable())
+    {
+        g_cam >> temp;
+        captured = g_get_monotonic_time();
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(g_frameLock);
+
+        // the newest frame may predate the motion; wait for one exposed
+        // after, and rather than detect on a stale image, fail
+        if (!g_frameReady.wait_for( lock,
+                                    std::chrono::milliseconds(PATTY_FACTORY_FRAME_TIMEOUT_MS),
+                                    [requested] { return (g_fresh && (g_frameNotBefore[g_middle] > requested)); }))
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, (char *) "PattyFactory: no new frame!\n");
+            PattyFactory_stageRecord(PATTY_STAGE_CAPTURE, start);
+            return (FALSE);
+        }
+
+        std::swap(g_front, g_middle);
+        g_fresh = false;
+
+        temp = g_frames[g_front];
+        captured = g_frameTimes[g_front];
+    }
+
+    if (temp.empty())
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, (char *) "PattyFactory: no frame has been captured.\n");
+        PattyFactory_stageRecord(PATTY_STAGE_CAPTURE, start);
+        return (FALSE);
+    }
+
+    // copy out of the triple buffer before the capture thread reuses it
+    temp.copyTo(g_current_frame);
+    g_current_frame_time = captured;
+
+    PattyFactory_stageRecord(PATTY_STAGE_CAPTURE, start);
+
+    return (TRUE);
+}
+
+gint64 PattyFactory_getFrameTime( void )
+{
+    return (g_current_frame_time);
 }
 
 void PattyFactory_setBgFromCam ( void )
 {
     g_bg = g_current_frame.clone();
+    g_bgDecimatedLevels = -1;
 }
 
 void PattyFactory_setFgFromCam ( void )
@@ -145,35 +424,440 @@ void PattyFactory_setBackProjFromCam ( void )
     g_src = g_current_frame.clone();
 }
 
+/* Each pyrDown applies a 5-tap kernel of variance 1 (at its input scale)
+   before halving, and each pyrUp about the same after doubling.  After
+   levels steps down and back up they contribute a variance of about
+   2 * (4^levels - 1) / 3 full-resolution pixels^2, so the blur at the
+   bottom level only has to make up the rest.  Stop descending once that
+   blur would be smaller than PYRAMID_BLUR_MIN_SIGMA. */
+static void PattyFactory_blurPyramid( const Mat & src, Mat & dst, double sigma )
+{
+    std::vector<Size> sizes;
+    Mat level = src;
+    double pyramidVar = 0.0;
+    double residual = sigma;
+    int levels;
+
+    for (levels = 0; ; levels++)
+    {
+        double nextVar = 2.0 * ((1 << (2 * (levels + 1))) - 1) / 3.0;
+        double nextScale = (double) (1 << (levels + 1));
+
+        if (    (sigma * sigma <= nextVar)
+            ||  (std::sqrt(sigma * sigma - nextVar) / nextScale < PYRAMID_BLUR_MIN_SIGMA)
+            ||  (level.cols < 16) || (level.rows < 16)  )
+            break;
+
+        pyramidVar = nextVar;
+        sizes.push_back(level.size());
+        pyrDown(level, level);
+    }
+
+    residual = std::sqrt(sigma * sigma - pyramidVar) / (1 << levels);
+
+    // not descended: level still shares the caller's data
+    if (0 == levels)
+    {
+        GaussianBlur(src, dst, Size(), residual);
+        return;
+    }
+
+    GaussianBlur(level, level, Size(), residual);
+
+    while (!sizes.empty())
+    {
+        pyrUp(level, level, sizes.back());
+        sizes.pop_back();
+    }
+
+    dst = level;
+}
+
+/* Three box filters approximate a Gaussian (Kovesi's widths: some passes
+   of width wl and the rest wl + 2, chosen so the variances sum to
+   sigma^2).  blur() uses running sums, so each pass is O(1) per pixel. */
+static void PattyFactory_blurBox3( const Mat & src, Mat & dst, double sigma )
+{
+    const int n = 3;
+    double wIdeal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+    int wl = (int) std::floor(wIdeal);
+    int m;
+    int i;
+
+    if (0 == wl % 2) wl--;
+    if (wl < 1) wl = 1;
+
+    m = (int) std::lround(  (12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n)
+                          / (-4.0 * wl - 4.0)   );
+
+    src.copyTo(dst);
+    for (i = 0; i < n; i++)
+    {
+        int w = (i < m) ? wl : wl + 2;
+        blur(dst, dst, Size(w, w));
+    }
+}
+
+static void PattyFactory_blur( const Mat & src, Mat & dst, double sigma, enum BLUR_MODE mode )
+{
+    switch (mode)
+    {
+        case BLUR_PYRAMID:
+            PattyFactory_blurPyramid(src, dst, sigma);
+            break;
+
+        case BLUR_BOX3:
+            PattyFactory_blurBox3(src, dst, sigma);
+            break;
+
+        case BLUR_EXACT:
+        default:
+            GaussianBlur(src, dst, Size(), sigma);
+            break;
+    }
+}
+
+/* grayscale absolute difference between foreground and background */
+static void PattyFactory_diffGray( const Mat & fg, const Mat & bg, Mat & diff )
+{
+    absdiff(fg, bg, diff);
+    cvtColor(diff, diff, COLOR_BGR2GRAY);
+}
+
 /* Warning: vomit-inducing mixture of C and C++                 */
 /* programming in the problem domain is for eggheads anyways... */
-static Mat PattyFactory_getBlobs_bg_subtract( void )
+static Mat PattyFactory_getBlobs_bg_subtract( int levels )
 {
+    Mat fg;
     Mat diff;
     Mat binary;
+    uint64_t start;
 
-    // get absolute value difference between background and foreground
-    absdiff(g_fg, g_bg, diff);
+    // bring both images to the detection scale; the background only once
+    start = PattyFactory_now();
+    fg = PattyFactory_decimate(g_fg, levels);
+    if (g_bgDecimatedLevels != levels)
+    {
+        g_bgDecimated = PattyFactory_decimate(g_bg, levels);
+        g_bgDecimatedLevels = levels;
+    }
+    if (levels > 0) PattyFactory_stageEnd(PATTY_STAGE_DECIMATE, start);
 
-    // convert result to grayscale
-    cvtColor(diff, diff, COLOR_BGR2GRAY);
+    // get grayscale absolute value difference between background and foreground
+    start = PattyFactory_now();
+    PattyFactory_diffGray(fg, g_bgDecimated, diff);
+    PattyFactory_stageEnd(PATTY_STAGE_ABSDIFF, start);
 
     // reject high-frequency content
-    GaussianBlur(diff, diff, Size(), BG_SUBTRACT_BLUR_SIGMA * DECIMATION_FACTOR);
+    start = PattyFactory_now();
+    PattyFactory_blur(  diff, diff,
+                        PattyFactory_decimatedSigma(BG_SUBTRACT_BLUR_SIGMA, levels),
+                        g_blurMode  );
+    PattyFactory_stageEnd(PATTY_STAGE_BLUR, start);
 
     // find pronounced differences in the image
+    start = PattyFactory_now();
     threshold(diff, binary, BG_SUBTRACT_THRESHOLD, 255.0, THRESH_BINARY);
+    PattyFactory_stageEnd(PATTY_STAGE_THRESHOLD, start);
 
     return (binary);
 }
 
+/* Fused back projection.  OpenCV's 8-bit BGR2HSV hue is computed with
+   integers: h = (n * hdiv[max - min] + 2^11) >> 12, where n is the signed
+   hue numerator of the max channel and hdiv[d] = round((180 << 12) / 6d),
+   plus 180 if negative.  Reproducing that arithmetic lets each pixel go
+   straight to its back-projection value through a 256-entry LUT (g_hueLut)
+   built from g_hist the same way calcBackProject bins hues, with no HSV or
+   hue image in between.  PattyFactory_checkBackProject() compares the
+   result with cvtColor + calcBackProject for every BGR triple. */
+#define PATTY_HSV_SHIFT     12
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PATTY_FACTORY_NEON  1
+#include <arm_neon.h>
+#endif
+
+static int      g_hdivTable[256];
+static int      g_hueLut[256];      /* hue -> back-projection value */
+static bool     g_hueLutReady = false;
+
+#ifdef PATTY_FACTORY_NEON
+/* g_hueLut as bytes, six 32-byte vtbl4 tables covering hues 0 to 191 */
+static uchar    g_hueLutBytes[192];
+#endif
+
+static void PattyFactory_buildHueLut( void )
+{
+    double a = g_histSize / ((double) HUE_RANGES[1] - HUE_RANGES[0]);
+    double b = -a * HUE_RANGES[0];
+    int h;
+    int bin;
+
+    g_hdivTable[0] = 0;
+    for (h = 1; h < 256; h++)
+        g_hdivTable[h] = (int) std::lround((180 << PATTY_HSV_SHIFT) / (6.0 * h));
+
+    // bin and round as calcBackProject does for 8-bit images
+    for (h = 0; h < 256; h++)
+    {
+        bin = (int) std::floor(h * a + b);
+        g_hueLut[h] = ((unsigned) bin < (unsigned) g_histSize)
+                      ? saturate_cast<uchar>(g_hist.at<float>(bin))
+                      : 0;
+    }
+
+#ifdef PATTY_FACTORY_NEON
+    for (h = 0; h < 192; h++)
+        g_hueLutBytes[h] = (uchar) g_hueLut[h];
+#endif
+
+    g_hueLutReady = true;
+}
+
+static void PattyFactory_backProjectRowScalar( const uchar * bgr, uchar * dst, int x, int width )
+{
+    int b, g, r;
+    int v, vmin, diff;
+    int h;
+
+    for ( ; x < width; x++, bgr += 3)
+    {
+        b = bgr[0];
+        g = bgr[1];
+        r = bgr[2];
+
+        v    = std::max(b, std::max(g, r));
+        vmin = std::min(b, std::min(g, r));
+        diff = v - vmin;
+
+        if (v == r)         h = g - b;
+        else if (v == g)    h = b - r + 2 * diff;
+        else                h = r - g + 4 * diff;
+
+        h = (h * g_hdivTable[diff] + (1 << (PATTY_HSV_SHIFT - 1))) >> PATTY_HSV_SHIFT;
+        if (h < 0) h += 180;
+
+        dst[x] = (uchar) g_hueLut[h];
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PATTY_FACTORY_AVX2  1
+#include <immintrin.h>
+
+/* 16 pixels per iteration: deinterleave 48 bytes with pshufb, compute the
+   hue numerator in 16-bit lanes, finish in two halves of eight 32-bit lanes
+   with gathers from g_hdivTable and g_hueLut.  Returns the first pixel not
+   processed. */
+__attribute__((target("avx2")))
+static int PattyFactory_backProjectRowAvx2( const uchar * bgr, uchar * dst, int width )
+{
+    const __m128i bMaskA = _mm_setr_epi8( 0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bMaskB = _mm_setr_epi8(-1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i bMaskC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13);
+    const __m128i gMaskA = _mm_setr_epi8( 1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gMaskB = _mm_setr_epi8(-1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i gMaskC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14);
+    const __m128i rMaskA = _mm_setr_epi8( 2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i rMaskB = _mm_setr_epi8(-1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i rMaskC = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15);
+    const __m256i round  = _mm256_set1_epi32(1 << (PATTY_HSV_SHIFT - 1));
+    const __m256i hueMax = _mm256_set1_epi32(180);
+    const __m256i zero   = _mm256_setzero_si256();
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16, bgr += 48)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *) (bgr +  0));
+        __m128i m = _mm_loadu_si128((const __m128i *) (bgr + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (bgr + 32));
+
+        __m256i b = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, bMaskA), _mm_shuffle_epi8(m, bMaskB)),
+                        _mm_shuffle_epi8(c, bMaskC)));
+        __m256i g = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, gMaskA), _mm_shuffle_epi8(m, gMaskB)),
+                        _mm_shuffle_epi8(c, gMaskC)));
+        __m256i r = _mm256_cvtepu8_epi16(_mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, rMaskA), _mm_shuffle_epi8(m, rMaskB)),
+                        _mm_shuffle_epi8(c, rMaskC)));
+
+        __m256i v    = _mm256_max_epi16(b, _mm256_max_epi16(g, r));
+        __m256i vmin = _mm256_min_epi16(b, _mm256_min_epi16(g, r));
+        __m256i diff = _mm256_sub_epi16(v, vmin);
+        __m256i vr   = _mm256_cmpeq_epi16(v, r);
+        __m256i vg   = _mm256_andnot_si256(vr, _mm256_cmpeq_epi16(v, g));
+
+        // n = g - b if max is r, else b - r + 2d if g, else r - g + 4d
+        __m256i hR = _mm256_sub_epi16(g, b);
+        __m256i hG = _mm256_add_epi16(_mm256_sub_epi16(b, r), _mm256_slli_epi16(diff, 1));
+        __m256i hB = _mm256_add_epi16(_mm256_sub_epi16(r, g), _mm256_slli_epi16(diff, 2));
+        __m256i n  = _mm256_blendv_epi8(_mm256_blendv_epi8(hB, hG, vg), hR, vr);
+
+        __m256i half[2];
+        int i;
+
+        for (i = 0; i < 2; i++)
+        {
+            __m128i n16 = i ? _mm256_extracti128_si256(n, 1)    : _mm256_castsi256_si128(n);
+            __m128i d16 = i ? _mm256_extracti128_si256(diff, 1) : _mm256_castsi256_si128(diff);
+            __m256i h   = _mm256_cvtepi16_epi32(n16);
+            __m256i div = _mm256_i32gather_epi32(g_hdivTable, _mm256_cvtepi16_epi32(d16), 4);
+
+            h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h, div), round), PATTY_HSV_SHIFT);
+            h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(zero, h), hueMax));
+
+            half[i] = _mm256_i32gather_epi32(g_hueLut, h, 4);
+        }
+
+        // 2 x 8 ints -> 16 shorts (fixing packs' lane order) -> 16 bytes
+        __m256i p16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(half[0], half[1]), 0xD8);
+        _mm_storeu_si128((__m128i *) (dst + x),
+                         _mm_packus_epi16(  _mm256_castsi256_si128(p16),
+                                            _mm256_extracti128_si256(p16, 1)    ));
+    }
+
+    return (x);
+}
+#endif
+
+#ifdef PATTY_FACTORY_NEON
+/* 8 pixels per iteration for the Cortex-A8: vld3 deinterleaves, the hue
+   numerator is computed in 16-bit lanes as for AVX2.  NEON has no gather,
+   so hdiv[d] is rebuilt in two halves of four 32-bit lanes from a
+   reciprocal estimate, then corrected to exactly round((180 << 12) / 6d);
+   the hue goes through g_hueLutBytes with vtbl4, which yields 0 for an
+   index past its 32 bytes, so OR-ing six lookups covers hues 0 to 179.
+   Returns the first pixel not processed. */
+static int PattyFactory_backProjectRowNeon( const uchar * bgr, uchar * dst, int width )
+{
+    const int32x4_t     scale   = vdupq_n_s32((180 << PATTY_HSV_SHIFT) / 6);
+    const float32x4_t   scaleF  = vdupq_n_f32((float) ((180 << PATTY_HSV_SHIFT) / 6));
+    const float32x4_t   halfF   = vdupq_n_f32(0.5f);
+    const int32x4_t     hueMax  = vdupq_n_s32(180);
+    const int16x8_t     one     = vdupq_n_s16(1);
+    uint8x8x4_t         lut[6];
+    int                 x;
+    int                 t;
+
+    for (t = 0; t < 6; t++)
+    {
+        lut[t].val[0] = vld1_u8(g_hueLutBytes + 32 * t +  0);
+        lut[t].val[1] = vld1_u8(g_hueLutBytes + 32 * t +  8);
+        lut[t].val[2] = vld1_u8(g_hueLutBytes + 32 * t + 16);
+        lut[t].val[3] = vld1_u8(g_hueLutBytes + 32 * t + 24);
+    }
+
+    for (x = 0; x + 8 <= width; x += 8, bgr += 24)
+    {
+        uint8x8x3_t px = vld3_u8(bgr);
+
+        int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(px.val[0]));
+        int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(px.val[1]));
+        int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(px.val[2]));
+
+        int16x8_t  v    = vmaxq_s16(b, vmaxq_s16(g, r));
+        int16x8_t  vmin = vminq_s16(b, vminq_s16(g, r));
+        int16x8_t  diff = vsubq_s16(v, vmin);
+        uint16x8_t vr   = vceqq_s16(v, r);
+        uint16x8_t vg   = vceqq_s16(v, g);
+
+        // n = g - b if max is r, else b - r + 2d if g, else r - g + 4d
+        int16x8_t hR = vsubq_s16(g, b);
+        int16x8_t hG = vaddq_s16(vsubq_s16(b, r), vshlq_n_s16(diff, 1));
+        int16x8_t hB = vaddq_s16(vsubq_s16(r, g), vshlq_n_s16(diff, 2));
+        int16x8_t n  = vbslq_s16(vr, hR, vbslq_s16(vg, hG, hB));
+
+        // diff 0 means n 0, so any divisor does; 1 keeps the estimate finite
+        int16x8_t d16 = vmaxq_s16(diff, one);
+
+        int32x4_t half[2];
+        int i;
+
+        for (i = 0; i < 2; i++)
+        {
+            int32x4_t   d   = vmovl_s16(i ? vget_high_s16(d16) : vget_low_s16(d16));
+            int32x4_t   h   = vmovl_s16(i ? vget_high_s16(n)   : vget_low_s16(n));
+            float32x4_t df  = vcvtq_f32_s32(d);
+            float32x4_t rcp = vrecpeq_f32(df);
+            int32x4_t   div;
+            int32x4_t   err;
+
+            rcp = vmulq_f32(vrecpsq_f32(df, rcp), rcp);
+            rcp = vmulq_f32(vrecpsq_f32(df, rcp), rcp);
+            div = vcvtq_s32_f32(vmlaq_f32(halfF, rcp, scaleF));
+
+            // within one of the rounded quotient; err = 2 * remainder
+            err = vshlq_n_s32(vmlsq_s32(scale, div, d), 1);
+            div = vsubq_s32(div, vreinterpretq_s32_u32(vcgtq_s32(err, d)));
+            div = vaddq_s32(div, vreinterpretq_s32_u32(vcltq_s32(err, vnegq_s32(d))));
+
+            h = vrshrq_n_s32(vmulq_s32(h, div), PATTY_HSV_SHIFT);
+            half[i] = vaddq_s32(h, vandq_s32(vshrq_n_s32(h, 31), hueMax));
+        }
+
+        uint8x8_t hue = vmovn_u16(vreinterpretq_u16_s16(vcombine_s16(  vmovn_s32(half[0]),
+                                                                        vmovn_s32(half[1])  )));
+        uint8x8_t out = vtbl4_u8(lut[0], hue);
+
+        for (t = 1; t < 6; t++)
+            out = vorr_u8(out, vtbl4_u8(lut[t], vsub_u8(hue, vdup_n_u8((uchar) (32 * t)))));
+
+        vst1_u8(dst + x, out);
+    }
+
+    return (x);
+}
+#endif
+
+class PattyFactory_backProjectBody : public ParallelLoopBody
+{
+public:
+    PattyFactory_backProjectBody( const Mat & bgr, Mat & dst, bool avx2 )
+        : m_bgr(bgr), m_dst(dst), m_avx2(avx2) {}
+
+    void operator()( const Range & rows ) const
+    {
+        for (int y = rows.start; y < rows.end; y++)
+        {
+            const uchar * src = m_bgr.ptr<uchar>(y);
+            uchar * dst = m_dst.ptr<uchar>(y);
+            int x = 0;
+
+#ifdef PATTY_FACTORY_AVX2
+            if (m_avx2) x = PattyFactory_backProjectRowAvx2(src, dst, m_bgr.cols);
+#endif
+#ifdef PATTY_FACTORY_NEON
+            x = PattyFactory_backProjectRowNeon(src, dst, m_bgr.cols);
+#endif
+            PattyFactory_backProjectRowScalar(src + 3 * x, dst, x, m_bgr.cols);
+        }
+    }
+
+private:
+    const Mat & m_bgr;
+    Mat &       m_dst;
+    bool        m_avx2;
+};
+
+/* one pass, row-parallel: BGR image to back projection of g_hist */
+static void PattyFactory_backProjectFused( const Mat & bgr, Mat & dst )
+{
+    static const bool avx2 = checkHardwareSupport(CV_CPU_AVX2);
+
+    dst.create(bgr.size(), CV_8UC1);
+    parallel_for_(  Range(0, bgr.rows),
+                    PattyFactory_backProjectBody(bgr, dst, avx2) );
+}
+
 void PattyFactory_setHistFromFile( const gchar * filename )
 {
     Mat src;
     Mat hue;
 
     // read image from file
-    PattyFactory_decimateMatFromFile(src, filename);
+    PattyFactory_matFromFile(src, filename);
 
     // convert to HSV and extract Hue only
     hue = PattyFactory_hueFromRgb(src);
@@ -182,24 +866,151 @@ void PattyFactory_setHistFromFile( const gchar * filename )
     calcHist(&hue, 1, 0, Mat(), g_hist, 1, &g_histSize, &g_ranges, true,
             false);
     normalize(g_hist, g_hist, 0, 255, NORM_MINMAX, -1, Mat());
+
+    PattyFactory_buildHueLut();
 }
 
-static Mat PattyFactory_getBlobs_back_project( void )
+gboolean PattyFactory_checkBackProject( const gchar *   frameFile,
+                                        gint            iterations,
+                                        FILE *          fptr    )
 {
+#if defined(PATTY_FACTORY_NEON)
+    const char * kernel = "NEON";
+#elif defined(PATTY_FACTORY_AVX2)
+    const char * kernel = checkHardwareSupport(CV_CPU_AVX2) ? "AVX2" : "scalar";
+#else
+    const char * kernel = "scalar";
+#endif
+    struct HISTOGRAM times;
+    MatND savedHist = g_hist;
+    bool savedReady = g_hueLutReady;
+    Mat frame;
+    Mat bgr(256, 256, CV_8UC3);
+    Mat hue;
+    Mat expected;
+    Mat fused;
+    Mat mismatch;
+    double separate;
+    double onePass;
+    long mismatches = 0;
+    uint64_t start;
+    int bin;
+    int r;
+    int y;
+    int x;
+    gint k;
+
+    if (!PattyFactory_matFromFile(frame, frameFile))
+        return (FALSE);
+
+    // a distinct value in every bin, so a hue put in the wrong bin shows
+    g_hist = Mat(g_histSize, 1, CV_32F);
+    for (bin = 0; bin < g_histSize; bin++)
+        g_hist.at<float>(bin) = 255.0f * (bin + 1) / g_histSize;
+    PattyFactory_buildHueLut();
+
+    // every BGR triple: one 256x256 image of (b, g) = (x, y) per red level
+    for (r = 0; r < 256; r++)
+    {
+        for (y = 0; y < 256; y++)
+        {
+            uchar * p = bgr.ptr<uchar>(y);
+
+            for (x = 0; x < 256; x++, p += 3)
+            {
+                p[0] = (uchar) x;
+                p[1] = (uchar) y;
+                p[2] = (uchar) r;
+            }
+        }
+
+        hue = PattyFactory_hueFromRgb(bgr);
+        calcBackProject(&hue, 1, 0, g_hist, expected, &g_ranges, 1, true);
+        PattyFactory_backProjectFused(bgr, fused);
+
+        compare(expected, fused, mismatch, CMP_NE);
+        mismatches += countNonZero(mismatch);
+    }
+
+    DEBUG_PRINT_LEVEL(fptr, (char *) "");
+    fprintf(fptr,   "PattyFactory: back projection check, %s kernel, %d threads: "
+                    "%ld of 16777216 BGR triples differ from cvtColor + calcBackProject.\n",
+                    kernel, getNumThreads(), mismatches);
+
+    Histogram_init(&times);
+    for (k = 0; k < iterations; k++)
+    {
+        start = PattyFactory_now();
+        hue = PattyFactory_hueFromRgb(frame);
+        calcBackProject(&hue, 1, 0, g_hist, expected, &g_ranges, 1, true);
+        Histogram_record(&times, PattyFactory_now() - start);
+    }
+    separate = Histogram_percentile(&times, 50.0) * 1e-6;
+
+    Histogram_init(&times);
+    for (k = 0; k < iterations; k++)
+    {
+        start = PattyFactory_now();
+        PattyFactory_backProjectFused(frame, fused);
+        Histogram_record(&times, PattyFactory_now() - start);
+    }
+    onePass = Histogram_percentile(&times, 50.0) * 1e-6;
+
+    DEBUG_PRINT_LEVEL(fptr, (char *) "");
+    fprintf(fptr,   "PattyFactory: %dx%d, %d iterations: cvtColor + calcBackProject "
+                    "median %.2f ms, fused %.2f ms (x%.1f).\n",
+                    frame.cols, frame.rows, iterations,
+                    separate, onePass, (onePass > 0.0) ? separate / onePass : 0.0);
+    fflush(fptr);
+
+    g_hist = savedHist;
+    if (savedReady) PattyFactory_buildHueLut();
+    else            g_hueLutReady = false;
+
+    return ((0 == mismatches) ? TRUE : FALSE);
+}
+
+static Mat PattyFactory_getBlobs_back_project( int levels )
+{
+    Mat src;
     Mat hue;
     Mat backproj;
+    uint64_t start;
 
-    // convert to HSV and extract Hue only
-    hue = PattyFactory_hueFromRgb(g_src);
+    start = PattyFactory_now();
+    src = PattyFactory_decimate(g_src, levels);
+    if (levels > 0) PattyFactory_stageEnd(PATTY_STAGE_DECIMATE, start);
+
+    if (g_hueLutReady)
+    {
+        // hue and back projection in one pass; charged to back projection
+        start = PattyFactory_now();
+        PattyFactory_backProjectFused(src, backproj);
+        PattyFactory_stageEnd(PATTY_STAGE_BACK_PROJECT, start);
+    }
+    else
+    {
+        // convert to HSV and extract Hue only
+        start = PattyFactory_now();
+        hue = PattyFactory_hueFromRgb(src);
+        PattyFactory_stageEnd(PATTY_STAGE_HUE, start);
 
-    // perform back-projection
-    calcBackProject(&hue, 1, 0, g_hist, backproj, &g_ranges, 1, true);
+        // perform back-projection
+        start = PattyFactory_now();
+        calcBackProject(&hue, 1, 0, g_hist, backproj, &g_ranges, 1, true);
+        PattyFactory_stageEnd(PATTY_STAGE_BACK_PROJECT, start);
+    }
 
     // reject high-frequency content
-    GaussianBlur(backproj, backproj, Size(), BACK_PROJECT_BLUR_SIGMA);
+    start = PattyFactory_now();
+    GaussianBlur(   backproj, backproj, Size(),
+                    PattyFactory_decimatedSigma(BACK_PROJECT_BLUR_SIGMA, levels)   );
+    PattyFactory_stageEnd(PATTY_STAGE_BLUR, start);
 
     // find pronounced differences in the image
+    start = PattyFactory_now();
     threshold(backproj, backproj, BACK_PROJECT_THRESHOLD, 255.0, THRESH_BINARY);
+    PattyFactory_stageEnd(PATTY_STAGE_THRESHOLD, start);
 
     return (backproj);
 }
@@ -207,33 +1018,280 @@ static Mat PattyFactory_getBlobs_back_project( void )
 GSList * PattyFactory_getPattyList( enum DETECTION_METHOD method )
 {
     Mat pattyBlobs;
+    Size full;
     GSList * pattyList = NULL;
+    int levels = g_decimation;
+    uint64_t start;
 
-    puts("applying method");
     switch (method)
     {
         case BG_SUBTRACT:
-            g_ui_post = g_fg.clone();
-            pattyBlobs = PattyFactory_getBlobs_bg_subtract();
+            full = g_fg.size();
+            pattyBlobs = PattyFactory_getBlobs_bg_subtract(levels);
             break;
 
         case BACK_PROJECT:
-            g_ui_post = g_src.clone();
-            pattyBlobs = PattyFactory_getBlobs_back_project();
+            full = g_src.size();
+            pattyBlobs = PattyFactory_getBlobs_back_project(levels);
             break;
     }
 
     // show the blobs as "pre"
-    puts("converting blobs to bgr");
+    start = PattyFactory_now();
     cvtColor(pattyBlobs, g_ui_post, COLOR_GRAY2BGR);
+    PattyFactory_stageEnd(PATTY_STAGE_DRAW, start);
 
     // create patties for each blob in the image
-    puts("getting list from blobs");
-    pattyList = PattyFactory_getPattyListFromBlobs(pattyBlobs);
+    pattyList = PattyFactory_getPattyListFromBlobs(pattyBlobs, levels, full);
+
+    PattyFactory_frameEnd();
 
     return (pattyList);
 }
 
+void PattyFactory_setBlurMode( enum BLUR_MODE mode )
+{
+    g_blurMode = mode;
+}
+
+enum BLUR_MODE PattyFactory_getBlurMode( void )
+{
+    return (g_blurMode);
+}
+
+gboolean PattyFactory_benchmarkBlur(    const gchar *   bgFile,
+                                        const gchar *   fgFile,
+                                        gint            iterations,
+                                        FILE *          fptr    )
+{
+    static const enum BLUR_MODE modes[] = { BLUR_EXACT, BLUR_PYRAMID, BLUR_BOX3 };
+    static const char * const   names[] = { "exact", "pyramid", "box3" };
+    const double sigma = BG_SUBTRACT_BLUR_SIGMA;
+    struct HISTOGRAM times;
+    Mat bg;
+    Mat fg;
+    Mat diff;
+    Mat exact;
+    Mat exactBinary;
+    Mat blurred;
+    Mat binary;
+    Mat error;
+    double exactMedian = 0.0;
+    double median;
+    double meanError;
+    double maxError;
+    double flipped;
+    uint64_t start;
+    size_t i;
+    gint k;
+
+    if (    !PattyFactory_matFromFile(bg, bgFile)
+        ||  !PattyFactory_matFromFile(fg, fgFile)   )
+        return (FALSE);
+
+    PattyFactory_diffGray(fg, bg, diff);
+    GaussianBlur(diff, exact, Size(), sigma);
+    threshold(exact, exactBinary, BG_SUBTRACT_THRESHOLD, 255.0, THRESH_BINARY);
+
+    DEBUG_PRINT_LEVEL(fptr, (char *) "");
+    fprintf(fptr,   "PattyFactory: blur benchmark, %dx%d, sigma %.1f, %d iterations:\n",
+                    diff.cols, diff.rows, sigma, iterations);
+    DEBUG_PRINT_LEVEL_ENTER();
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        Histogram_init(&times);
+        for (k = 0; k < iterations; k++)
+        {
+            start = PattyFactory_now();
+            PattyFactory_blur(diff, blurred, sigma, modes[i]);
+            Histogram_record(&times, PattyFactory_now() - start);
+        }
+
+        absdiff(blurred, exact, error);
+        meanError = norm(error, NORM_L1) / error.total();
+        maxError  = norm(error, NORM_INF);
+
+        threshold(blurred, binary, BG_SUBTRACT_THRESHOLD, 255.0, THRESH_BINARY);
+        bitwise_xor(binary, exactBinary, binary);
+        flipped = 100.0 * countNonZero(binary) / binary.total();
+
+        median = Histogram_percentile(&times, 50.0) * 1e-6;
+        if (BLUR_EXACT == modes[i]) exactMedian = median;
+
+        DEBUG_PRINT_LEVEL(fptr, (char *) "");
+        fprintf(fptr,   "%-8s median %8.2f ms (x%5.1f)  error mean %5.2f max %5.1f  "
+                        "threshold mismatch %6.3f%%\n",
+                        names[i],
+                        median,
+                        (median > 0.0) ? exactMedian / median : 0.0,
+                        meanError,
+                        maxError,
+                        flipped );
+    }
+
+    DEBUG_PRINT_LEVEL_EXIT();
+    fflush(fptr);
+
+    return (TRUE);
+}
+
+void PattyFactory_setDecimation( gint levels )
+{
+    if (levels < 0)                     levels = 0;
+    if (levels > DECIMATION_MAX_LEVELS) levels = DECIMATION_MAX_LEVELS;
+
+    g_decimation = levels;
+}
+
+gint PattyFactory_getDecimation( void )
+{
+    return (g_decimation);
+}
+
+gboolean PattyFactory_benchmarkDecimation(  const gchar *   bgFile,
+                                            const gchar *   fgFile,
+                                            gint            iterations,
+                                            FILE *          fptr    )
+{
+    struct HISTOGRAM times;
+    std::vector<Rect> boxes;
+    std::vector<Point2d> reference;
+    std::vector<Point2d> found;
+    Mat bg;
+    Mat fg;
+    Mat bgSmall;
+    Mat fgSmall;
+    Mat diff;
+    Mat binary;
+    double fullMedian = 0.0;
+    double median;
+    double nearest;
+    double meanError;
+    double maxError;
+    uint64_t start;
+    size_t i;
+    size_t j;
+    int levels;
+    gint k;
+
+    if (    !PattyFactory_matFromFile(bg, bgFile)
+        ||  !PattyFactory_matFromFile(fg, fgFile)   )
+        return (FALSE);
+
+    DEBUG_PRINT_LEVEL(fptr, (char *) "");
+    fprintf(fptr,   "PattyFactory: decimation benchmark, %dx%d, %d iterations:\n",
+                    fg.cols, fg.rows, iterations);
+    DEBUG_PRINT_LEVEL_ENTER();
+
+    for (levels = 0; levels <= DECIMATION_MAX_LEVELS; levels++)
+    {
+        // detection decimates the background once, not every frame
+        bgSmall = PattyFactory_decimate(bg, levels);
+
+        Histogram_init(&times);
+        for (k = 0; k < iterations; k++)
+        {
+            start = PattyFactory_now();
+            fgSmall = PattyFactory_decimate(fg, levels);
+            PattyFactory_diffGray(fgSmall, bgSmall, diff);
+            PattyFactory_blur(  diff, diff,
+                                PattyFactory_decimatedSigma(BG_SUBTRACT_BLUR_SIGMA, levels),
+                                g_blurMode  );
+            threshold(diff, binary, BG_SUBTRACT_THRESHOLD, 255.0, THRESH_BINARY);
+            PattyFactory_findBlobs(binary, boxes);
+            Histogram_record(&times, PattyFactory_now() - start);
+        }
+
+        found.clear();
+        for (i = 0; i < boxes.size(); i++)
+            found.push_back(PattyFactory_blobCenter(boxes[i], levels));
+        if (0 == levels) reference = found;
+
+        // distance from each full-resolution patty to the nearest one found
+        meanError = 0.0;
+        maxError  = 0.0;
+        for (i = 0; (i < reference.size()) && !found.empty(); i++)
+        {
+            nearest = norm(reference[i] - found[0]);
+            for (j = 1; j < found.size(); j++)
+                nearest = std::min(nearest, norm(reference[i] - found[j]));
+
+            meanError += nearest / reference.size();
+            maxError   = std::max(maxError, nearest);
+        }
+
+        median = Histogram_percentile(&times, 50.0) * 1e-6;
+        if (0 == levels) fullMedian = median;
+
+        DEBUG_PRINT_LEVEL(fptr, (char *) "");
+        fprintf(fptr,   "1/%-2d %4dx%-4d median %8.2f ms (x%5.1f)  patties %3u/%-3u  ",
+                        1 << levels,
+                        fgSmall.cols,
+                        fgSmall.rows,
+                        median,
+                        (median > 0.0) ? fullMedian / median : 0.0,
+                        (unsigned int) found.size(),
+                        (unsigned int) reference.size() );
+
+        if (found.empty() && !reference.empty())
+            fprintf(fptr, "none found\n");
+        else
+            fprintf(fptr, "error mean %6.2f max %6.2f px\n", meanError, maxError);
+    }
+
+    DEBUG_PRINT_LEVEL_EXIT();
+    fflush(fptr);
+
+    return (TRUE);
+}
+
+void PattyFactory_setTimingLog( gboolean enable )
+{
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    g_timingLog = (FALSE != enable);
+}
+
+void PattyFactory_printTiming( FILE * fptr )
+{
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    struct HISTOGRAM histogram;
+    int stage;
+
+    DEBUG_PRINT_LEVEL(fptr, (char *) "PattyFactory stage times, recent frames:\n");
+    DEBUG_PRINT_LEVEL_ENTER();
+    for (stage = 0; stage < PATTY_STAGE_COUNT; stage++)
+    {
+        Histogram_windowGet(&g_stageTimes[stage], &histogram);
+        Histogram_print(&histogram, fptr, g_stageNames[stage], 1e6, "ms");
+    }
+    DEBUG_PRINT_LEVEL_EXIT();
+    fflush(fptr);
+}
+
+void PattyFactory_resetTiming( void )
+{
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    int stage;
+
+    for (stage = 0; stage < PATTY_STAGE_COUNT; stage++)
+    {
+        Histogram_windowInit(&g_stageTimes[stage], PATTY_FACTORY_TIMING_SLOT_FRAMES);
+        g_stageNs[stage] = 0;
+    }
+}
+
+guint64 PattyFactory_getStagePercentile(    enum PATTY_FACTORY_STAGE    stage,
+                                            gdouble                     percentile  )
+{
+    std::lock_guard<std::mutex> lock(g_timingLock);
+    struct HISTOGRAM histogram;
+
+    Histogram_windowGet(&g_stageTimes[stage], &histogram);
+
+    return (Histogram_percentile(&histogram, percentile));
+}
+
 Mat PattyFactory_getPreImage( void )
 {
     return (g_current_frame);
@@ -21,6 +21,38 @@ Note that it is necessary to free this list yourself;  however, to use it
 with RecipeList_buildFromPattyList() as intended, you must free the list
 nodes WITHOUT freeing the contained Patty structs (refer to the GLib
 reference).  These will be freed when you call RecipeList_removeDone().
+
+PattyFactory_init() starts a capture thread which reads the camera
+continuously into a triple buffer, so the driver's queue never holds stale
+frames.  PattyFactory_updateFrame() then takes the newest frame whose
+exposure began after the call (waiting at most
+PATTY_FACTORY_FRAME_TIMEOUT_MS, one to two frame periods in practice), so
+detection runs on an image taken after the robot moved out of view.  It
+returns FALSE, leaving the current frame as it was, if no such frame
+arrives in time, or none has been captured at all.  PattyFactory_getFrameTime() returns the frame's capture
+time: the driver's timestamp where the backend gives one.  Call
+PattyFactory_shdn() to stop the thread and release the camera.
+
+The wall time of each pipeline stage is recorded in a rolling window of the
+last few dozen frames (capture: of the last few dozen updateFrame calls, one
+sample each); PattyFactory_printTiming() prints its percentiles.
+PattyFactory_setTimingLog(TRUE) also logs every frame's stage times, which
+is off by default to keep stdio out of the detection path.
+
+The large background subtraction blur may be approximated for speed with
+PattyFactory_setBlurMode(): BLUR_PYRAMID blurs a pyrDown'd copy and scales
+it back up, BLUR_BOX3 runs three box filters (running sums, so the cost does
+not grow with sigma).  PattyFactory_benchmarkBlur() compares both with the
+exact Gaussian on a recorded background/foreground pair.
+
+Frames and loaded images are kept at full resolution.  With
+PattyFactory_setDecimation(levels), detection runs on a copy pyrDown'd
+levels times (1/2, 1/4 or 1/8 scale); the blur sigmas are scaled to match
+and the found centroids are mapped back to full-resolution coordinates, so
+patty positions keep the same units at every level.  The blob image
+returned by PattyFactory_getPostImage() is at the decimated scale.
+PattyFactory_benchmarkDecimation() reports the detection time and centroid
+error of each level on a recorded background/foreground pair.
  */
 
 #ifdef __cplusplus
@@ -43,21 +75,101 @@ extern "C"
         BACK_PROJECT
     };
 
+    enum BLUR_MODE
+    {
+        BLUR_EXACT,     /* GaussianBlur                              */
+        BLUR_PYRAMID,   /* pyrDown, small GaussianBlur, pyrUp        */
+        BLUR_BOX3       /* three box filters of Gaussian-equivalent width */
+    };
+
+    enum PATTY_FACTORY_STAGE
+    {
+        PATTY_STAGE_CAPTURE,        /* each updateFrame, with the wait   */
+        PATTY_STAGE_DECIMATE,       /* pyrDown to the detection scale    */
+        PATTY_STAGE_HUE,            /* BGR to hue (no histogram yet)     */
+        PATTY_STAGE_BACK_PROJECT,   /* back projection, fused with hue   */
+        PATTY_STAGE_ABSDIFF,        /* absdiff and grayscale             */
+        PATTY_STAGE_BLUR,           /* GaussianBlur                      */
+        PATTY_STAGE_THRESHOLD,
+        PATTY_STAGE_CONTOURS,       /* contours, bounding boxes, patties */
+        PATTY_STAGE_DRAW,           /* UI images and markers             */
+        PATTY_STAGE_COUNT
+    };
+
     int     PattyFactory_init( void );
+    void    PattyFactory_shdn( void );
     
     void    PattyFactory_setBgFromFile      ( const gchar * filename );
     void    PattyFactory_setFgFromFile      ( const gchar * filename );
     void    PattyFactory_setBackProjFromFile( const gchar * filename );
     
-    void    PattyFactory_updateFrame        ( void );
+    gboolean PattyFactory_updateFrame       ( void );
+    gint64  PattyFactory_getFrameTime       ( void );
     
     void    PattyFactory_setBgFromCam       ( void );
     void    PattyFactory_setFgFromCam       ( void );
     void    PattyFactory_setBackProjFromCam ( void );
 
+    /* also rebuilds the hue -> back-projection LUT, after which
+       BACK_PROJECT detection goes straight from BGR to back projection in
+       one row-parallel pass (NEON on ARM, AVX2 where an x86 CPU has it) */
     void    PattyFactory_setHistFromFile    ( const gchar * filename );
 
+    /*  PattyFactory_checkBackProject( frameFile, iterations, fptr )
+     *  Runs the one-pass back projection (NEON, AVX2 or scalar, whichever
+     *  this build and CPU use) on every BGR triple with a histogram that
+     *  has a distinct value in each bin, and counts the pixels that differ
+     *  from cvtColor + calcBackProject.  Then times both paths on the
+     *  frame, iterations times each.  The histogram and LUT in use are
+     *  restored afterwards.
+     *  Returns FALSE if the frame could not be read or any pixel differs.
+     */
+    gboolean PattyFactory_checkBackProject  (   const gchar *   frameFile,
+                                                gint            iterations,
+                                                FILE *          fptr    );
+
     GSList * PattyFactory_getPattyList      ( enum DETECTION_METHOD method );
+
+    /* levels of pyrDown before detection, 0 to DECIMATION_MAX_LEVELS */
+    void    PattyFactory_setDecimation      ( gint levels );
+    gint    PattyFactory_getDecimation      ( void );
+
+    /*  PattyFactory_benchmarkDecimation( bgFile, fgFile, iterations, fptr )
+     *  Runs background subtraction detection on the two images at each
+     *  decimation level (with the current blur mode), iterations times,
+     *  and prints each level's time and how its patties compare with
+     *  those found at full resolution: the number found, and the mean and
+     *  maximum distance (full-resolution pixels) from each full-resolution
+     *  patty to the nearest one found.
+     *  Returns FALSE if an image could not be read.
+     */
+    gboolean PattyFactory_benchmarkDecimation(  const gchar *   bgFile,
+                                                const gchar *   fgFile,
+                                                gint            iterations,
+                                                FILE *          fptr    );
+
+    void    PattyFactory_setBlurMode        ( enum BLUR_MODE mode );
+    enum BLUR_MODE PattyFactory_getBlurMode ( void );
+
+    /*  PattyFactory_benchmarkBlur( bgFile, fgFile, iterations, fptr )
+     *  Blurs the background subtraction difference of the two images with
+     *  each blur mode, iterations times, and prints each mode's time and
+     *  its error against BLUR_EXACT: mean and maximum absolute difference,
+     *  and the fraction of pixels on the other side of the threshold.
+     *  Returns FALSE if an image could not be read.
+     */
+    gboolean PattyFactory_benchmarkBlur     (   const gchar *   bgFile,
+                                                const gchar *   fgFile,
+                                                gint            iterations,
+                                                FILE *          fptr    );
+
+    void    PattyFactory_setTimingLog       ( gboolean enable );
+    void    PattyFactory_printTiming        ( FILE * fptr );
+    void    PattyFactory_resetTiming        ( void );
+
+    /* rolling percentile of a stage's wall time, in nanoseconds */
+    guint64 PattyFactory_getStagePercentile (   enum PATTY_FACTORY_STAGE    stage,
+                                                gdouble                     percentile  );
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -65,13 +177,26 @@ extern "C"
 #define MM_PER  30
 #define PX_PER  51
 
-#define DECIMATION_FACTOR       1
+/* detection scale is 1 / 2^levels */
+#define DECIMATION_LEVELS       0
+#define DECIMATION_MAX_LEVELS   3
 
+/* longest PattyFactory_updateFrame() waits for a fresh frame */
+#define PATTY_FACTORY_FRAME_TIMEOUT_MS  1000
+
+/* stage times are kept for the last 3-4 slots of this many frames */
+#define PATTY_FACTORY_TIMING_SLOT_FRAMES    16
+
+/* blur sigmas are in full-resolution pixels */
 #define BG_SUBTRACT_BLUR_SIGMA  30.0
+#define BG_SUBTRACT_BLUR_MODE   BLUR_EXACT
 #define BG_SUBTRACT_THRESHOLD   40.0
 
 #define BACK_PROJECT_BLUR_SIGMA 5.0
 #define BACK_PROJECT_THRESHOLD  200.0
 
+/* BLUR_PYRAMID blurs with at least this sigma at the level it stops at */
+#define PYRAMID_BLUR_MIN_SIGMA  1.5
+
 #endif /* PATTYFACTORY_HPP */
 
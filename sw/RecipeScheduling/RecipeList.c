@@ -19,6 +19,11 @@ static void RecipeList_foreach_build( gpointer data, gpointer recipes )
     *((GSList **) recipes) = g_slist_prepend(*((GSList **) recipes), temp);
 }
 
+static void RecipeList_foreach_assign( gpointer data, gpointer planner )
+{
+    ((struct Patty *) data)->planner = planner;
+}
+
 static void RecipeList_foreach_run( gpointer data, gpointer count )
 {
     gboolean        success;
@@ -45,21 +50,62 @@ static void RecipeList_foreach_run( gpointer data, gpointer count )
     g_free((gpointer) name);
 }
 
+static void RecipeList_foreach_collectProbes( gpointer data, gpointer patties )
+{
+    struct Recipe *     recipe = data;
+    struct RecipeStep * step;
+    struct Patty *      patty;
+
+    step = g_queue_peek_head(recipe->steps);
+    if ((NULL == step) || ((DoneChecker) Patty_isDone != step->DoneCheck))
+        return;
+
+    /* skip patties measured recently enough for Patty_isDone to reuse */
+    patty = recipe->ingredient;
+    if (    (0 != patty->tempTime)
+        &&  (g_get_monotonic_time() - patty->tempTime < PATTY_TEMP_MAX_AGE_US)   )
+        return;
+
+    *((GSList **) patties) = g_slist_prepend(*((GSList **) patties), patty);
+}
+
 static gint RecipeList_foreach_findDone( gconstpointer recipe, gconstpointer dontcare )
 {
     /* if recipe is done, return 0 */
     return (!Recipe_isDone((struct Recipe *) recipe));
 }
 
-void RecipeList_buildFromPattyList(GSList * patties, GSList ** recipes)
+void RecipeList_buildFromPattyList(struct MOTION_PLANNER * planner, GSList * patties, GSList ** recipes)
 {
+    g_slist_foreach(patties, RecipeList_foreach_assign, planner);
     g_slist_foreach(patties, RecipeList_foreach_build, recipes);
 }
 
-void RecipeList_tryAll(GSList * recipes)
+/* Measure, in one robot sweep, every patty whose pending step checks for
+   doneness, so that Patty_isDone can use the cached temperatures.  A robot
+   that cannot sweep leaves Patty_isDone to probe each patty itself. */
+void RecipeList_sweepTemperatures(struct MOTION_PLANNER * planner, GSList * recipes)
+{
+    GSList * patties = NULL;
+
+    g_slist_foreach(recipes, RecipeList_foreach_collectProbes, &patties);
+    if (NULL != patties)
+    {
+        Patty_sweepTemperatures(planner, patties);
+        g_slist_free(patties);
+    }
+}
+
+void RecipeList_tryAll(struct MOTION_PLANNER * planner, GSList * recipes)
 {
     gint i = 0;
+
+    RecipeList_sweepTemperatures(planner, recipes);
     g_slist_foreach(recipes, RecipeList_foreach_run, &i);
+
+    /* every pass ends with the robot parked */
+    MotionPlanner_Settle(planner);
+    MotionPlanner_ReportCycle(planner, G_SYSTEM_LOG);
 }
 
 void RecipeList_removeDone(GSList ** recipes)
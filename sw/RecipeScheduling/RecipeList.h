@@ -17,8 +17,9 @@ from a GSList of Patty structs and performing operations on it.
 #include "Patty.h"
 #include "Recipe.h"
 
-void RecipeList_buildFromPattyList(GSList * patties, GSList ** recipes);
-void RecipeList_tryAll(GSList * recipes);
+void RecipeList_buildFromPattyList(struct MOTION_PLANNER * planner, GSList * patties, GSList ** recipes);
+void RecipeList_sweepTemperatures(struct MOTION_PLANNER * planner, GSList * recipes);
+void RecipeList_tryAll(struct MOTION_PLANNER * planner, GSList * recipes);
 void RecipeList_removeDone(GSList ** recipes);
 
 #endif /*RECIPELIST_H*/
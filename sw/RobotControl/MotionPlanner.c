@@ -0,0 +1,283 @@
+
+/*
+File:   MotionPlanner.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements the motion planner declared in MotionPlanner.h.
+
+MotionPlanner_Home() only marks a Home as pending.  Before each other
+command, the planner checks its homeBefore table for that command:
+
+    - if the command must start from home and the robot is not there, the
+      Home is executed first (whether or not one was pending);
+    - otherwise a pending Home is dropped, and the robot moves directly.
+
+By default (g_homeBeforeDefault) every command must start from home: the
+robot programs' approach paths were only ever checked from the home pose,
+and moving directly between two grill positions, or from the deposit
+chute back over the grill, has not been shown to clear the cell, the
+conveyor or the camera.  Photo in particular must approach its pose from
+outside the camera's field of view.  So the Homes dropped by default are
+only the ones that are provably redundant:
+
+    - Home followed by Home (or by a command requiring it) with the robot
+      already at home, which moves nothing;
+    - MotionPlanner_Settle() with no Home pending and the robot at a
+      known position.
+
+MotionPlanner_SetHomeBefore() clears the requirement for a command once
+its direct transitions have been verified on the cell.  The scheduler
+must call MotionPlanner_Settle() before running the conveyor or going
+idle, so that the robot is parked clear of the cell.
+
+A failed move leaves the robot's position unknown, which forces a Home
+before the next command that requires one.
+
+Time saved is estimated from the mean duration of the Home moves actually
+executed (MOTION_PLANNER_HOME_ESTIMATE_S until one has been measured).
+*/
+
+#include "MotionPlanner.h"
+
+#define MOTION_PLANNER_N_COMMANDS       (RCTL_COMMAND_SWEEP + 1)
+#define MOTION_PLANNER_HOME_ESTIMATE_S  (2.0)
+
+static const int g_homeBeforeDefault[MOTION_PLANNER_N_COMMANDS] =
+{
+    [RCTL_COMMAND_PHOTO]    = 1,
+    [RCTL_COMMAND_HERE]     = 1,
+    [RCTL_COMMAND_TEMP]     = 1,
+    [RCTL_COMMAND_FLIP]     = 1,
+    [RCTL_COMMAND_DEPOSIT]  = 1,
+    [RCTL_COMMAND_SWEEP]    = 1
+};
+
+struct MOTION_PLANNER
+{
+    struct ROBOT_CONTROL *  robot;
+    int                     homeBefore[MOTION_PLANNER_N_COMMANDS];
+
+    int                     position;
+    int                     homePending;
+
+    double                  homeSeconds;    /* total of executed Homes */
+    unsigned long           nHomes;
+    unsigned long           nElided;        /* this cycle */
+    unsigned long           nElidedTotal;
+    unsigned long           nCycles;
+};
+
+
+static double MotionPlanner_seconds( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec + now.tv_nsec * 1e-9);
+}
+
+static double MotionPlanner_homeEstimate( struct MOTION_PLANNER * planner )
+{
+    return ((planner->nHomes > 0) ? (planner->homeSeconds / planner->nHomes)
+                                  : MOTION_PLANNER_HOME_ESTIMATE_S);
+}
+
+static int MotionPlanner_executeHome( struct MOTION_PLANNER * planner )
+{
+    double start;
+    int status;
+
+    start = MotionPlanner_seconds();
+    status = RobotControl_Home(planner->robot);
+
+    if (RCTL_E_NO_ERROR == status)
+    {
+        planner->homeSeconds += MotionPlanner_seconds() - start;
+        planner->nHomes++;
+        planner->position = MOTION_AT_HOME;
+    }
+    else
+    {
+        planner->position = MOTION_AT_UNKNOWN;
+    }
+
+    planner->homePending = 0;
+
+    return (status);
+}
+
+/* Resolve a pending Home before command; returns the status of the Home if
+   one was executed. */
+static int MotionPlanner_prepare( struct MOTION_PLANNER * planner, int command )
+{
+    if (planner->homeBefore[command] && (MOTION_AT_HOME != planner->position))
+        return (MotionPlanner_executeHome(planner));
+
+    if (planner->homePending)
+    {
+        planner->homePending = 0;
+        planner->nElided++;
+        planner->nElidedTotal++;
+    }
+
+    return (RCTL_E_NO_ERROR);
+}
+
+static int MotionPlanner_finish( struct MOTION_PLANNER * planner, int status, int position )
+{
+    planner->position = (RCTL_E_NO_ERROR == status) ? position : MOTION_AT_UNKNOWN;
+
+    return (status);
+}
+
+struct MOTION_PLANNER * MotionPlanner_new( struct ROBOT_CONTROL * robot )
+{
+    struct MOTION_PLANNER * planner;
+
+    planner = calloc(1, sizeof(struct MOTION_PLANNER));
+    if (NULL == planner) return (NULL);
+
+    planner->robot    = robot;
+    planner->position = MOTION_AT_UNKNOWN;
+    memcpy(planner->homeBefore, g_homeBeforeDefault, sizeof(planner->homeBefore));
+
+    return (planner);
+}
+
+void MotionPlanner_free( struct MOTION_PLANNER * planner )
+{
+    free(planner);
+}
+
+int MotionPlanner_Home( struct MOTION_PLANNER * planner )
+{
+    /* already home: nothing to do, and no motion saved */
+    if (MOTION_AT_HOME != planner->position)
+        planner->homePending = 1;
+
+    return (RCTL_E_NO_ERROR);
+}
+
+int MotionPlanner_Photo( struct MOTION_PLANNER * planner )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_PHOTO);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    return (MotionPlanner_finish(   planner,
+                                    RobotControl_Photo(planner->robot),
+                                    MOTION_AT_PHOTO ));
+}
+
+int MotionPlanner_Here( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_HERE);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    return (MotionPlanner_finish(   planner,
+                                    RobotControl_Here(planner->robot, targetPose),
+                                    MOTION_AT_GRILL ));
+}
+
+int MotionPlanner_Temp( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_TEMP);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    return (MotionPlanner_finish(   planner,
+                                    RobotControl_Temp(planner->robot, targetPose),
+                                    MOTION_AT_GRILL ));
+}
+
+int MotionPlanner_Flip( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_FLIP);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    return (MotionPlanner_finish(   planner,
+                                    RobotControl_Flip(planner->robot, targetPose),
+                                    MOTION_AT_GRILL ));
+}
+
+int MotionPlanner_Deposit( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_DEPOSIT);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    return (MotionPlanner_finish(   planner,
+                                    RobotControl_Deposit(planner->robot, targetPose),
+                                    MOTION_AT_DEPOSIT ));
+}
+
+int MotionPlanner_Sweep(struct MOTION_PLANNER *       planner,
+                        const struct ROBOT_POSE_3D *  waypoints,
+                        int                   nWaypoints,
+                        RCTL_DWELL_CALLBACK   onDwell,
+                        void *                dwellData )
+{
+    int status;
+
+    status = MotionPlanner_prepare(planner, RCTL_COMMAND_SWEEP);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
+    status = RobotControl_Sweep(planner->robot, waypoints, nWaypoints, onDwell, dwellData);
+
+    return (MotionPlanner_finish(planner, status, MOTION_AT_GRILL));
+}
+
+int MotionPlanner_Settle( struct MOTION_PLANNER * planner )
+{
+    if (planner->homePending || (MOTION_AT_UNKNOWN == planner->position))
+        return (MotionPlanner_executeHome(planner));
+
+    return (RCTL_E_NO_ERROR);
+}
+
+void MotionPlanner_SetHomeBefore( struct MOTION_PLANNER * planner, int command, int required )
+{
+    if ((command > RCTL_COMMAND_HOME) && (command < MOTION_PLANNER_N_COMMANDS))
+        planner->homeBefore[command] = required;
+}
+
+int MotionPlanner_GetPosition( struct MOTION_PLANNER * planner )
+{
+    return (planner->position);
+}
+
+struct ROBOT_CONTROL * MotionPlanner_GetRobot( struct MOTION_PLANNER * planner )
+{
+    return (planner->robot);
+}
+
+void MotionPlanner_ReportCycle( struct MOTION_PLANNER * planner, FILE * fptr )
+{
+    double estimate = MotionPlanner_homeEstimate(planner);
+
+    planner->nCycles++;
+
+    DEBUG_PRINT_LEVEL(fptr, "");
+    fprintf(fptr,   "MotionPlanner: cycle %lu dropped %lu Home moves, "
+                    "saving ~%.1f s (%lu dropped, ~%.1f s saved in total; "
+                    "mean Home %.2f s).\n",
+                    planner->nCycles,
+                    planner->nElided,
+                    planner->nElided * estimate,
+                    planner->nElidedTotal,
+                    planner->nElidedTotal * estimate,
+                    estimate );
+    fflush(fptr);
+
+    planner->nElided = 0;
+}
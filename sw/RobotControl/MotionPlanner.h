@@ -0,0 +1,75 @@
+#ifndef MOTION_PLANNER_H
+#define MOTION_PLANNER_H
+
+/*
+File:   MotionPlanner.h
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file declares a motion layer between the recipe scheduler and
+RobotControl.  It has the same motion calls as RobotControl, but a Home
+move is deferred rather than executed: it is only carried out if the next
+command requires the robot to start from home, or when the scheduler
+settles the robot before going idle.  By default every command requires
+home, so only redundant Homes are dropped; a Home before a command whose
+direct transitions have been verified is dropped once
+MotionPlanner_SetHomeBefore() clears its requirement.
+
+The planner tracks the robot's logical position, and counts how many Home
+moves it dropped and how much motion time that saved, per cook cycle.
+
+Each planner drives one robot (see RobotControl_Init()), so a process may
+run one planner per cell.  A planner is not thread-safe; call it from its
+cell's scheduler thread only.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "RobotControl.h"
+
+#define MOTION_AT_UNKNOWN   0
+#define MOTION_AT_HOME      1
+#define MOTION_AT_PHOTO     2
+#define MOTION_AT_GRILL     3   /* here, temp, flip, sweep */
+#define MOTION_AT_DEPOSIT   4
+
+/* per-robot planner state; see MotionPlanner.c */
+struct MOTION_PLANNER;
+
+/*  MotionPlanner_new( robot )
+ *  Returns a planner for robot (NULL if out of memory).  The planner does
+ *  not own the robot: free the planner before calling RobotControl_Shdn().
+ */
+struct MOTION_PLANNER * MotionPlanner_new ( struct ROBOT_CONTROL * robot );
+void    MotionPlanner_free      ( struct MOTION_PLANNER * planner );
+
+int     MotionPlanner_Home      ( struct MOTION_PLANNER * planner );
+int     MotionPlanner_Photo     ( struct MOTION_PLANNER * planner );
+int     MotionPlanner_Here      ( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose );
+int     MotionPlanner_Temp      ( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose );
+int     MotionPlanner_Flip      ( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose );
+int     MotionPlanner_Deposit   ( struct MOTION_PLANNER * planner, struct ROBOT_POSE_3D * targetPose );
+int     MotionPlanner_Sweep     ( struct MOTION_PLANNER *       planner,
+                                  const struct ROBOT_POSE_3D *  waypoints,
+                                  int                   nWaypoints,
+                                  RCTL_DWELL_CALLBACK   onDwell,
+                                  void *                dwellData );
+
+/* carry out a deferred Home, if any; call before idling or moving the cell */
+int     MotionPlanner_Settle    ( struct MOTION_PLANNER * planner );
+
+/*  MotionPlanner_SetHomeBefore( planner, command, required )
+ *  Sets whether command must start from home (see the defaults in
+ *  MotionPlanner.c).
+ */
+void    MotionPlanner_SetHomeBefore( struct MOTION_PLANNER * planner, int command, int required );
+
+int     MotionPlanner_GetPosition( struct MOTION_PLANNER * planner );
+struct ROBOT_CONTROL * MotionPlanner_GetRobot( struct MOTION_PLANNER * planner );
+
+/* log this cycle's dropped Home moves and time saved, then start a new cycle */
+void    MotionPlanner_ReportCycle( struct MOTION_PLANNER * planner, FILE * fptr );
+
+#endif /* MOTION_PLANNER_H */
@@ -7,23 +7,100 @@ Author: Peter Lapets
 Description:
 This file implements an API for controlling a UR3 robot via Modbus TCP/PI.
 
-Before calling any of these functions, you must call RobotControl_Init() to
-connect to the robot.  If a connection cannot be made, the function will
-abort().
+Each robot is represented by an opaque handle which carries its own Modbus
+connections, command queue and robot thread, pose shadow and statistics.
+There is no global state, so one process may drive several robots (e.g.
+one per grill station) from separate threads.
 
-You must call RobotControl_Refresh() periodically during long idle periods
-to ensure that the server does not close the connection.
+Before calling any of these functions, you must call RobotControl_Init() to
+connect to a robot and obtain its handle.  If a connection cannot be made,
+RobotControl_Init() returns NULL.  A NULL address or port is taken from the
+RCTL_SERVER_IP and RCTL_SERVER_PORT environment variables, or failing that
+from MODBUS_SERVER_IP and MODBUS_SERVER_PORT (see also RobotSim.c).
+
+The robot thread keeps the connection alive while idle, and re-establishes
+it with bounded exponential backoff if it drops.  Reads are retried once the
+connection is back.  A command interrupted by a drop is waited on again if
+it is still in the command register.  If the robot program implements the
+sequence protocol (see RCTL_ADDRESS_SEQUENCE; RobotControl_Init() probes
+for it), a command is otherwise resolved from its sequence number: reported
+done if the robot accepted it and has already finished, and resubmitted
+only if the robot provably never took it.  Anything else is returned as an
+error rather than risk running a Flip or Deposit twice.
+RobotControl_Refresh() sends a keepalive immediately, but need no longer be
+called periodically.
 
 You may then call the following functions to control the robot:
 
-    RobotControl_Home   ( void );
-    RobotControl_Photo  ( void );
-    RobotControl_Here   ( struct ROBOT_POSE_3D * targetPose );
-    RobotControl_Temp   ( struct ROBOT_POSE_3D * targetPose );
-    RobotControl_Flip   ( struct ROBOT_POSE_3D * targetPose );
-    RobotControl_Deposit( struct ROBOT_POSE_3D * targetPose );
-
-    RobotControl_EStop  ( void );
+    RobotControl_Home   ( robot );
+    RobotControl_Photo  ( robot );
+    RobotControl_Here   ( robot, struct ROBOT_POSE_3D * targetPose );
+    RobotControl_Temp   ( robot, struct ROBOT_POSE_3D * targetPose );
+    RobotControl_Flip   ( robot, struct ROBOT_POSE_3D * targetPose );
+    RobotControl_Deposit( robot, struct ROBOT_POSE_3D * targetPose );
+    RobotControl_Sweep  ( robot, waypoints, nWaypoints, onDwell, dwellData );
+
+    RobotControl_EStop  ( robot );
+
+RobotControl_Sweep() visits up to RCTL_SWEEP_MAX_WAYPOINTS poses in a single
+command.  The waypoints are written to the sweep block before the command,
+and onDwell(index, dwellData) is called each time the robot reports that it
+has arrived at a waypoint; the robot does not move on until the callback has
+returned and the dwell has been acknowledged.  A sweep interrupted by a drop
+resumes from the robot's current dwell once reconnected; if the robot stays
+unreachable the sweep is aborted (RCTL_SWEEP_ACK_ABORT) before the error is
+returned, so the probe is not left on a patty, as it is if the sweep
+overruns RCTL_SWEEP_LEG_TIMEOUT_MS per waypoint.  Only robot programs with
+the sequence protocol implement the sweep; check RobotControl_CanSweep()
+first.
+
+Each of these blocks until the robot reports completion.  Motions are
+executed one at a time, in order, by the handle's robot thread; the
+blocking functions simply queue their command and wait for it.  To overlap
+other work with a motion, use the *Async variants instead:
+
+    job = RobotControl_FlipAsync(robot, &pose, NULL, NULL);
+    ... process images, sample temperatures ...
+    status = RobotControl_JobWait(job);
+    RobotControl_JobFree(job);
+
+RobotControl_JobPoll() returns RCTL_E_PENDING until the job completes.  A
+callback, if given, runs on the robot thread when the job completes; to
+fire and forget, pass a callback and free the handle immediately.
+
+Below the queue, RobotControl_Submit() writes a command to the robot and
+returns a future that RobotControl_Poll() (one Modbus round trip, never
+blocks) or RobotControl_Wait() (polls with adaptive backoff) completes.
+Every Modbus transaction is made under the handle's lock, so the future API
+and RobotControl_Refresh() may be used from any thread, but the caller is
+then responsible for not interleaving its commands with those of the queue.
+
+Every read that includes the current pose registers (135-137) -- status
+block reads, completion polls and idle keepalives -- updates a pose shadow.
+RobotControl_GetPose() returns it without touching the robot, and the
+pose-less commands (Home, Photo) echo it back instead of reading the pose.
+
+RobotControl_EStop() uses its own connection, so it is never held up behind
+a motion in progress.
+
+Every Modbus round trip, mutex claim wait, command completion time and
+retry count is recorded, per command type, in the handle's histograms (see
+Histogram.h).  RobotControl_DumpLatency() prints them, so the Modbus
+overhead of a cook cycle can be told apart from arm motion.  libmodbus's own
+frame dump is off unless RCTL_MODBUS_DEBUG is set in the environment, or
+enabled with RobotControl_SetModbusDebug().
+
+Commands are submitted with RCTL_SUBMIT_PACKED by default: reads of the
+status block (128-137), backing off while the mutex is held as the legacy
+claim does, then a single write_and_read_registers (FC23) that writes the
+command and target pose as one contiguous block (130-134) and returns the
+new status block.  The mutex is neither claimed nor written: the server
+applies the write atomically, so the robot never sees a command without
+its pose.  If the returned block shows that the robot took the mutex
+around the write, the submit waits for it to let go and checks that the
+command was not cleared over, writing it again if it was.
+RobotControl_SetSubmitMode() selects the original per-register handshake
+(RCTL_SUBMIT_LEGACY) instead.
 
 Coordinates are stored in ROBOT_POSE_3D structures in millimeters as signed
 16-bit integers.  As the robot is ignorant of this fact, it is necessary
@@ -31,30 +108,292 @@ to convert from unsigned to signed 16-bit values in the program that runs
 on the robot.
 
 When you are finished controlling the robot, you must call
-RobotControl_Shdn() to close the connection and free associated resources.
+RobotControl_Shdn() to close the connection and free the handle.
 */
 
 #include "RobotControl.h"
 
-static modbus_t * g_modbus = NULL;
+struct RCTL_JOB
+{
+    struct ROBOT_CONTROL *  robot;
+    struct RCTL_JOB *       next;
+    uint16_t                command;
+    int                     hasPose;
+    struct ROBOT_POSE_3D    pose;
+    RCTL_CALLBACK           callback;
+    void *                  userData;
+    int                     status;     /* RCTL_E_PENDING until complete */
+    int                     detached;   /* freed by the robot thread     */
+
+    /* RCTL_COMMAND_SWEEP only */
+    int                     nWaypoints;
+    struct ROBOT_POSE_3D    waypoints[RCTL_SWEEP_MAX_WAYPOINTS];
+    RCTL_DWELL_CALLBACK     onDwell;
+    void *                  dwellData;
+};
+
+struct ROBOT_CONTROL
+{
+    char                    serverIp  [RCTL_ENDPOINT_MAX];
+    char                    serverPort[RCTL_ENDPOINT_MAX];
+
+    modbus_t *              modbus;
+    modbus_t *              modbusEStop;
+    int                     submitMode;
+    struct RCTL_CONNECTION_STATS connStats;
+
+    /* per-command latency; transactions are charged to txCommand and retries
+       counted in txRetries, both under modbusLock */
+    pthread_mutex_t         statsLock;
+    struct RCTL_LATENCY     latency[RCTL_N_COMMANDS];
+    uint16_t                txCommand;
+    unsigned int            txRetries;
+
+    /* sequence number of the last command submitted, and whether the robot
+       echoes it to ACCEPTED, both under modbusLock */
+    uint16_t                sequence;
+    int                     echoesSequence;
+
+    /* one Modbus transaction (or claim..release group) at a time on modbus */
+    pthread_mutex_t         modbusLock;
+    pthread_mutex_t         estopLock;
+
+    /* last current pose read from the robot; poseTime == 0 if never */
+    pthread_mutex_t         poseLock;
+    struct ROBOT_POSE_3D    pose;
+    uint64_t                poseTime;
+
+    /* command queue; queueLock also protects job status and detached flags */
+    pthread_mutex_t         queueLock;
+    pthread_cond_t          queueCond;
+    pthread_cond_t          doneCond;
+    struct RCTL_JOB *       queueHead;
+    struct RCTL_JOB *       queueTail;
+    pthread_t               thread;
+    int                     running;
+    int                     stop;
+};
+
+
+/* the registers that show how far the robot got with a command */
+struct RCTL_COMMAND_STATE
+{
+    uint16_t                accepted;
+    uint16_t                command;
+    uint16_t                sequence;
+};
+
+
+static uint64_t RobotControl_now( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+static void RobotControl_record(   struct ROBOT_CONTROL * robot,
+                                    struct HISTOGRAM * histogram,
+                                    uint64_t value  )
+{
+    pthread_mutex_lock(&robot->statsLock);
+    Histogram_record(histogram, value);
+    pthread_mutex_unlock(&robot->statsLock);
+}
+
+/* charge a Modbus round trip begun at start to the command in progress */
+static void RobotControl_roundTrip( struct ROBOT_CONTROL * robot, uint64_t start )
+{
+    RobotControl_record(robot,
+                        &robot->latency[robot->txCommand].roundTripNs,
+                        RobotControl_now() - start);
+}
+
+static void RobotControl_poseUpdate(   struct ROBOT_CONTROL * robot,
+                                        const uint16_t * currentPose    )
+{
+    pthread_mutex_lock(&robot->poseLock);
+    memcpy(&robot->pose, currentPose, sizeof(struct ROBOT_POSE_3D));
+    robot->poseTime = RobotControl_now();
+    pthread_mutex_unlock(&robot->poseLock);
+}
+
+/* copy the shadow if it is younger than maxAgeNs */
+static int RobotControl_poseGetFresh(   struct ROBOT_CONTROL * robot,
+                                        struct ROBOT_POSE_3D * pose,
+                                        uint64_t maxAgeNs   )
+{
+    int status = RCTL_E_NO_POSE;
+
+    pthread_mutex_lock(&robot->poseLock);
+    if ((0 != robot->poseTime) && (RobotControl_now() - robot->poseTime <= maxAgeNs))
+    {
+        *pose = robot->pose;
+        status = RCTL_E_NO_ERROR;
+    }
+    pthread_mutex_unlock(&robot->poseLock);
+
+    return (status);
+}
+
+static int RobotControl_isConnectionError( int err )
+{
+    switch (err)
+    {
+        case EIO:
+        case EPIPE:
+        case EBADF:
+        case ENOTCONN:
+        case ETIMEDOUT:
+        case ECONNRESET:
+        case ECONNABORTED:
+        case ECONNREFUSED:
+            return (1);
+        default:
+            return (0);
+    }
+}
+
+/* must hold robot->modbusLock */
+static int RobotControl_reconnect( struct ROBOT_CONTROL * robot )
+{
+    unsigned int delayMs = RCTL_RECONNECT_MIN_MS;
+    int attempt;
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: UR3 dropped connection.  Reconnecting...\n");
+
+    for (attempt = 0; attempt < RCTL_RECONNECT_ATTEMPTS; attempt++)
+    {
+        modbus_close(robot->modbus);
+        if (0 == modbus_connect(robot->modbus))
+        {
+            robot->connStats.nReconnects++;
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+            fprintf(G_SYSTEM_LOG, "RobotControl: reconnected after %d attempts.\n", attempt + 1);
+            return (RCTL_E_NO_ERROR);
+        }
+
+        usleep(delayMs * 1000);
+        delayMs *= 2;
+        if (delayMs > RCTL_RECONNECT_MAX_MS)
+            delayMs = RCTL_RECONNECT_MAX_MS;
+    }
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: could not reconnect!\n");
+
+    return (RCTL_E_MODBUS_CONNECT);
+}
+
+/* modbus_read_registers() on robot->modbus, reconnecting and retrying if the
+   connection dropped.  Must hold robot->modbusLock. */
+static int RobotControl_readRegisters(  struct ROBOT_CONTROL * robot,
+                                        int address,
+                                        int nb,
+                                        uint16_t * dest )
+{
+    uint64_t start;
+    int nRegisters;
+    int attempt;
+    int thisErr;
+
+    for (attempt = 0; ; attempt++)
+    {
+        start = RobotControl_now();
+        nRegisters = modbus_read_registers(robot->modbus, address, nb, dest);
+        RobotControl_roundTrip(robot, start);
+        if (nb == nRegisters) break;
+
+        thisErr = errno;
+        if (    !RobotControl_isConnectionError(thisErr)
+            ||  (attempt >= RCTL_READ_RETRIES)
+            ||  (RCTL_E_NO_ERROR != RobotControl_reconnect(robot))   )
+        {
+            errno = thisErr;
+            break;
+        }
+
+        robot->connStats.nRetries++;
+        robot->txRetries++;
+    }
+
+    return (nRegisters);
+}
+
+/* modbus_write_register() on robot->modbus, reconnecting and retrying if the
+   connection dropped.  Must hold robot->modbusLock. */
+static int RobotControl_writeRegister(  struct ROBOT_CONTROL * robot,
+                                        int address,
+                                        uint16_t value  )
+{
+    uint64_t start;
+    int nRegisters;
+    int attempt;
+    int thisErr;
+
+    for (attempt = 0; ; attempt++)
+    {
+        start = RobotControl_now();
+        nRegisters = modbus_write_register(robot->modbus, address, value);
+        RobotControl_roundTrip(robot, start);
+        if (1 == nRegisters) break;
+
+        thisErr = errno;
+        if (    !RobotControl_isConnectionError(thisErr)
+            ||  (attempt >= RCTL_READ_RETRIES)
+            ||  (RCTL_E_NO_ERROR != RobotControl_reconnect(robot))   )
+        {
+            errno = thisErr;
+            break;
+        }
+
+        robot->connStats.nRetries++;
+        robot->txRetries++;
+    }
+
+    return (nRegisters);
+}
+
+static void RobotControl_backoffInit( struct RCTL_BACKOFF * backoff,
+                                      unsigned int minUs,
+                                      unsigned int maxUs )
+{
+    backoff->delayUs = minUs;
+    backoff->minUs   = minUs;
+    backoff->maxUs   = maxUs;
+}
+
+/* sleep for the current delay, then double it (up to the maximum) */
+static void RobotControl_backoffWait( struct RCTL_BACKOFF * backoff )
+{
+    usleep(backoff->delayUs);
 
+    backoff->delayUs *= 2;
+    if (backoff->delayUs > backoff->maxUs)
+        backoff->delayUs = backoff->maxUs;
+}
 
-static int RobotControl_modbusClaim( void )
+static int RobotControl_modbusClaim( struct ROBOT_CONTROL * robot )
 {
+    struct RCTL_BACKOFF backoff;
+    uint64_t claimStart = RobotControl_now();
+    uint64_t start;
     uint16_t busy;
     int nRegisters;
     int status = RCTL_E_NO_ERROR;
     int thisErr;
 
-    do
+    RobotControl_backoffInit(   &backoff,
+                                RCTL_CLAIM_BACKOFF_MIN_US,
+                                RCTL_CLAIM_BACKOFF_MAX_US );
+
+    while (1)
     {
-        nRegisters = modbus_read_registers( g_modbus,
-                                            RCTL_ADDRESS_MUTEX,
-                                            1,
-                                            &busy);
+        nRegisters = RobotControl_readRegisters( robot, RCTL_ADDRESS_MUTEX,
+                                                 1,
+                                                 &busy);
         thisErr = errno;
-        usleep(RCTL_USLEEP_PERIOD);
-        
+
         if (1 != nRegisters)
         {
             status = RCTL_E_MODBUS_CLAIM_R;
@@ -62,30 +401,46 @@ static int RobotControl_modbusClaim( void )
             fprintf(G_SYSTEM_LOG, "(modbus error: %s)", modbus_strerror(thisErr));
             break;
         }
-    } while (busy);
+
+        /* an uncontended claim costs no sleep at all */
+        if (!busy) break;
+
+        robot->txRetries++;
+        RobotControl_backoffWait(&backoff);
+    }
     
     if (1 == nRegisters)
     {
-        nRegisters = modbus_write_register( g_modbus,
+        start = RobotControl_now();
+        nRegisters = modbus_write_register( robot->modbus,
                                             RCTL_ADDRESS_MUTEX,
                                             1 );
+        RobotControl_roundTrip(robot, start);
                                             
         /* if everything up to this point ok */
         if (1 != nRegisters)
         {
             status = RCTL_E_MODBUS_CLAIM_W;
         }
+        else
+        {
+            RobotControl_record(robot,
+                                &robot->latency[robot->txCommand].claimNs,
+                                RobotControl_now() - claimStart);
+        }
     }
     
     return (status);
 }
 
-static int RobotControl_modbusRelease( void )
+static int RobotControl_modbusRelease( struct ROBOT_CONTROL * robot )
 {
+    uint64_t start = RobotControl_now();
     int nRegisters = 0;
     int status = RCTL_E_MODBUS_RELEASE;
 
-    nRegisters = modbus_write_register(g_modbus, RCTL_ADDRESS_MUTEX, 0);
+    nRegisters = modbus_write_register(robot->modbus, RCTL_ADDRESS_MUTEX, 0);
+    RobotControl_roundTrip(robot, start);
     if (1 == nRegisters)
         status = RCTL_E_NO_ERROR;
 
@@ -93,34 +448,38 @@ static int RobotControl_modbusRelease( void )
 }
 
 /* must claim registers first! */
-static int RobotControl_getCurrentPose( struct ROBOT_POSE_3D * currentPose )
+static int RobotControl_getCurrentPose( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * currentPose )
 {
     int nRegisters = 0;
     int status = RCTL_E_MODBUS_READ;
 
-    nRegisters = modbus_read_registers( g_modbus,
-                                        RCTL_ADDRESS_CURRENT_POSE,
-                                        3,
-                                        (uint16_t *) currentPose
-                                        );
+    nRegisters = RobotControl_readRegisters( robot, RCTL_ADDRESS_CURRENT_POSE,
+                                             3,
+                                             (uint16_t *) currentPose
+                                             );
 
     if ((nRegisters * 2) == sizeof(struct ROBOT_POSE_3D))
+    {
+        RobotControl_poseUpdate(robot, (uint16_t *) currentPose);
         status = RCTL_E_NO_ERROR;
+    }
 
     return (status);
 }
 
 /* must claim registers first! */
-static int RobotControl_setTargetPose( struct ROBOT_POSE_3D * targetPose )
+static int RobotControl_setTargetPose( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose )
 {
+    uint64_t start = RobotControl_now();
     int nRegisters = 0;
     int status = RCTL_E_MODBUS_WRITE;
 
-    nRegisters = modbus_write_registers(    g_modbus,
+    nRegisters = modbus_write_registers(    robot->modbus,
                                             RCTL_ADDRESS_TARGET_POSE,
                                             3,
                                             (uint16_t *) targetPose
                                         );
+    RobotControl_roundTrip(robot, start);
 
     if ((nRegisters * 2) == sizeof(struct ROBOT_POSE_3D))
         status = RCTL_E_NO_ERROR;
@@ -128,156 +487,1104 @@ static int RobotControl_setTargetPose( struct ROBOT_POSE_3D * targetPose )
     return (status);
 }
 
-static int RobotControl_setCommand( int command )
+/* write the command and its sequence number (130-131) in one request */
+static int RobotControl_setCommand( struct ROBOT_CONTROL * robot, int command, uint16_t sequence )
 {
+    uint16_t block[2];
+    uint64_t start = RobotControl_now();
     int nRegisters = 0;
     int status = RCTL_E_MODBUS_WRITE;
 
-    nRegisters = modbus_write_register( g_modbus,
+    block[RCTL_ADDRESS_COMMAND  - RCTL_ADDRESS_COMMAND] = command;
+    block[RCTL_ADDRESS_SEQUENCE - RCTL_ADDRESS_COMMAND] = sequence;
+
+    nRegisters = modbus_write_registers(robot->modbus,
                                         RCTL_ADDRESS_COMMAND,
-                                        command );
+                                        2,
+                                        block );
+    RobotControl_roundTrip(robot, start);
 
-    if (1 == nRegisters)
+    if (2 == nRegisters)
         status = RCTL_E_NO_ERROR;
 
     return (status);
 }
 
-static int RobotControl_getCommand( uint16_t * command )
+/* A single read is atomic on the server, so the command registers can be
+   polled without claiming the mutex.  The read also covers the current pose
+   (129-137), which keeps the pose shadow up to date during motions. */
+static int RobotControl_getCommand( struct ROBOT_CONTROL * robot, struct RCTL_COMMAND_STATE * state )
 {
+    uint16_t block[RCTL_ADDRESS_CURRENT_POSE + 3 - RCTL_ADDRESS_ACCEPTED];
     int nRegisters = 0;
     int status = RCTL_E_MODBUS_READ;
 
-    nRegisters = modbus_read_registers( g_modbus,
-                                        RCTL_ADDRESS_COMMAND,
-                                        1,
-                                        command );
+    nRegisters = RobotControl_readRegisters( robot, RCTL_ADDRESS_ACCEPTED,
+                                             sizeof(block) / sizeof(block[0]),
+                                             block );
 
-    if (1 == nRegisters)
+    if ((sizeof(block) / sizeof(block[0])) == nRegisters)
+    {
+        state->accepted = block[RCTL_ADDRESS_ACCEPTED - RCTL_ADDRESS_ACCEPTED];
+        state->command  = block[RCTL_ADDRESS_COMMAND  - RCTL_ADDRESS_ACCEPTED];
+        state->sequence = block[RCTL_ADDRESS_SEQUENCE - RCTL_ADDRESS_ACCEPTED];
+        RobotControl_poseUpdate(robot, &block[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_ACCEPTED]);
         status = RCTL_E_NO_ERROR;
+    }
 
     return (status);
 }
 
-static int RobotControl_sendCommandInfo(uint16_t command,
+/* a fresh sequence number; never 0, which the robot may start out with.
+   Must hold robot->modbusLock. */
+static uint16_t RobotControl_nextSequence( struct ROBOT_CONTROL * robot )
+{
+    if (0 == ++robot->sequence) ++robot->sequence;
+
+    return (robot->sequence);
+}
+
+/* Claim the registers, write the target pose (or re-write the current pose
+   when targetPose is NULL) and the command, then release.  Does not wait. */
+static int RobotControl_writeCommand(   struct ROBOT_CONTROL * robot,
+                                        uint16_t command,
+                                        uint16_t sequence,
                                         struct ROBOT_POSE_3D * target   )
 {
-    int status = RCTL_E_MODBUS_WRITE;
-    uint16_t readCommand;
-    
+    struct ROBOT_POSE_3D currentPose;
+    int status;
+
+    status = RobotControl_modbusClaim(robot);
+    if (RCTL_E_NO_ERROR != status) return (status);
+
     do
     {
-        /* claim registers      */
-        status = RobotControl_modbusClaim();
-        if (RCTL_E_NO_ERROR != status) break;
+        if (NULL == target)
+        {
+            if (RCTL_E_NO_ERROR != RobotControl_poseGetFresh(
+                                    robot,
+                                    &currentPose,
+                                    RCTL_POSE_SHADOW_MAX_AGE_MS * 1000000ULL))
+            {
+                status = RobotControl_getCurrentPose(robot, &currentPose);
+                if (RCTL_E_NO_ERROR != status) break;
+            }
+
+            target = &currentPose;
+        }
 
-        /* write data           */
-        status = RobotControl_setTargetPose(target);
+        status = RobotControl_setTargetPose(robot, target);
         if (RCTL_E_NO_ERROR != status) break;
 
-        status = RobotControl_setCommand(command);
+        status = RobotControl_setCommand(robot, command, sequence);
         if (RCTL_E_NO_ERROR != status) break;
+    } while (0);
+
+    /* always give the mutex back, but keep the first error */
+    if (RCTL_E_NO_ERROR == status)
+        status = RobotControl_modbusRelease(robot);
+    else
+        RobotControl_modbusRelease(robot);
+
+    return (status);
+}
+
+/* Wait for the mutex to be free and return the status block (128-137). */
+static int RobotControl_readStatusBlock( struct ROBOT_CONTROL * robot, uint16_t * block )
+{
+    struct RCTL_BACKOFF backoff;
+    uint64_t claimStart = RobotControl_now();
+    int nRegisters;
+    int thisErr;
+
+    RobotControl_backoffInit(   &backoff,
+                                RCTL_CLAIM_BACKOFF_MIN_US,
+                                RCTL_CLAIM_BACKOFF_MAX_US );
+
+    while (1)
+    {
+        nRegisters = RobotControl_readRegisters( robot, RCTL_ADDRESS_STATUS_BLOCK,
+                                                 RCTL_STATUS_BLOCK_SIZE,
+                                                 block );
+        thisErr = errno;
+
+        if (RCTL_STATUS_BLOCK_SIZE != nRegisters)
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+            fprintf(G_SYSTEM_LOG, "(modbus error: %s)", modbus_strerror(thisErr));
+            return (RCTL_E_MODBUS_CLAIM_R);
+        }
+
+        RobotControl_poseUpdate(robot, &block[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_STATUS_BLOCK]);
+
+        if (!block[RCTL_ADDRESS_MUTEX - RCTL_ADDRESS_STATUS_BLOCK]) break;
+
+        robot->txRetries++;
+        RobotControl_backoffWait(&backoff);
+    }
+
+    /* the packed path never holds the mutex; waiting for it to be free is
+       its claim */
+    RobotControl_record(robot,
+                        &robot->latency[robot->txCommand].claimNs,
+                        RobotControl_now() - claimStart);
+
+    return (RCTL_E_NO_ERROR);
+}
+
+/* Two round trips: status read, backing off while the mutex is held, then
+   one FC23 transaction that writes the command and target pose (130-134)
+   and reads the status block back.  The mutex and 129 are not written, so
+   nothing the robot set between the two is overwritten.
+
+   If the status read back shows the mutex held, the robot claimed the
+   registers around the write and may be clearing the command register.
+   Once it lets go, the command must still be there, or be running.  No
+   motion is over this soon, so a command register back at
+   RCTL_COMMAND_WAIT means it was cleared over (ACCEPTED is no help: the
+   idle loop echoes SEQUENCE), and the command is written again, up to
+   RCTL_PACKED_REWRITES times. */
+static int RobotControl_writeCommandPacked( struct ROBOT_CONTROL * robot,
+                                            uint16_t command,
+                                            uint16_t sequence,
+                                            struct ROBOT_POSE_3D * target   )
+{
+    uint16_t status[RCTL_STATUS_BLOCK_SIZE];
+    uint16_t submit[RCTL_SUBMIT_BLOCK_SIZE];
+    uint64_t start;
+    int nRewrites = 0;
+    int nRegisters;
+    int thisErr;
+    int result;
+
+    result = RobotControl_readStatusBlock(robot, status);
+    if (RCTL_E_NO_ERROR != result) return (result);
+
+    memset(submit, 0, sizeof(submit));
+    submit[RCTL_ADDRESS_COMMAND  - RCTL_ADDRESS_SUBMIT_BLOCK] = command;
+    submit[RCTL_ADDRESS_SEQUENCE - RCTL_ADDRESS_SUBMIT_BLOCK] = sequence;
+
+    /* with no target, re-send the current pose, as the legacy path does */
+    memcpy( &submit[RCTL_ADDRESS_TARGET_POSE - RCTL_ADDRESS_SUBMIT_BLOCK],
+            (NULL != target)
+            ? (uint16_t *) target
+            : &status[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_STATUS_BLOCK],
+            sizeof(struct ROBOT_POSE_3D) );
+
+    while (1)
+    {
+        start = RobotControl_now();
+        nRegisters = modbus_write_and_read_registers(   robot->modbus,
+                                                        RCTL_ADDRESS_SUBMIT_BLOCK,
+                                                        RCTL_SUBMIT_BLOCK_SIZE,
+                                                        submit,
+                                                        RCTL_ADDRESS_STATUS_BLOCK,
+                                                        RCTL_STATUS_BLOCK_SIZE,
+                                                        status );
+        thisErr = errno;
+        RobotControl_roundTrip(robot, start);
+
+        if (RCTL_STATUS_BLOCK_SIZE != nRegisters)
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+            fprintf(G_SYSTEM_LOG, "(modbus error: %s)", modbus_strerror(thisErr));
+            return (RCTL_E_MODBUS_WRITE);
+        }
+
+        RobotControl_poseUpdate(robot, &status[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_STATUS_BLOCK]);
+
+        if (!status[RCTL_ADDRESS_MUTEX - RCTL_ADDRESS_STATUS_BLOCK])
+            return (RCTL_E_NO_ERROR);
+
+        /* the robot holds the mutex: wait for it, then see what it left */
+        robot->txRetries++;
+        result = RobotControl_readStatusBlock(robot, status);
+        if (RCTL_E_NO_ERROR != result) return (result);
+
+        if (RCTL_COMMAND_WAIT != status[RCTL_ADDRESS_COMMAND - RCTL_ADDRESS_STATUS_BLOCK])
+            return (RCTL_E_NO_ERROR);
+
+        if (nRewrites++ >= RCTL_PACKED_REWRITES)
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: robot keeps clearing the command!\n");
+            return (RCTL_E_CLEARED);
+        }
+
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command cleared under the mutex; writing it again.\n");
+    }
+}
+
+/* record the outcome of a submission begun at submitNs; a failed command
+   has no meaningful completion time, but its retries still count */
+static void RobotControl_recordCompletion(  struct ROBOT_CONTROL * robot,
+                                            uint16_t command,
+                                            uint64_t submitNs,
+                                            int status  )
+{
+    struct RCTL_LATENCY * latency = &robot->latency[command % RCTL_N_COMMANDS];
+
+    pthread_mutex_lock(&robot->statsLock);
+    if (RCTL_E_NO_ERROR == status)
+        Histogram_record(&latency->completionNs, RobotControl_now() - submitNs);
+    Histogram_record(&latency->retries, robot->txRetries);
+    pthread_mutex_unlock(&robot->statsLock);
+}
+
+static void RobotControl_complete( struct RCTL_FUTURE * future, int status )
+{
+    future->status = status;
+    RobotControl_recordCompletion(  future->robot,
+                                    future->command,
+                                    future->submitNs,
+                                    status );
+
+    if (NULL != future->callback)
+        future->callback(future->command, status, future->userData);
+}
+
+static int RobotControl_sendCommandInfo(struct ROBOT_CONTROL * robot,
+                                        uint16_t command,
+                                        struct ROBOT_POSE_3D * target   )
+{
+    struct RCTL_FUTURE future;
+    struct RCTL_COMMAND_STATE state;
+    int submitFailed;
+    int nRecoveries = 0;
+    int echoes;
+    int failure;
+    int status;
+
+    status = RobotControl_Submit(robot, &future, command, target, NULL, NULL);
+    submitFailed = (RCTL_E_PENDING != status);
+
+    while (1)
+    {
+        if (RCTL_E_PENDING == status)
+            status = RobotControl_Wait(&future);
+
+        if ((RCTL_E_NO_ERROR == status) || (nRecoveries++ >= RCTL_RESUBMIT_MAX))
+            break;
+
+        /* known not to have run; but its sequence number was echoed while
+           idle, so the registers below would say it had finished */
+        if (RCTL_E_CLEARED == status)
+            break;
+
+        /* The connection may have dropped mid-command, or the write may
+           have been applied even though its reply was lost.  Reading the
+           command registers (which reconnects if need be) shows whether
+           the robot took the command. */
+        failure = status;
+        pthread_mutex_lock(&robot->modbusLock);
+        robot->txCommand = command;
+        status = RobotControl_getCommand(robot, &state);
+        echoes = robot->echoesSequence;
+
+        /* a legacy claim may have been left behind by the failed submit */
+        if (    (RCTL_E_NO_ERROR == status)
+            &&  submitFailed
+            &&  (RCTL_SUBMIT_LEGACY == robot->submitMode)    )
+        {
+            modbus_write_register(robot->modbus, RCTL_ADDRESS_MUTEX, 0);
+        }
+        pthread_mutex_unlock(&robot->modbusLock);
 
-        /* release registers    */
-        status = RobotControl_modbusRelease();
         if (RCTL_E_NO_ERROR != status) break;
 
-        /* wait for command = 0 */
-        do
+        if (echoes && (future.sequence == state.accepted))
         {
-            RobotControl_modbusClaim();
-            RobotControl_getCommand(&readCommand);
-            RobotControl_modbusRelease();
-        } while (RCTL_COMMAND_WAIT != readCommand);
-        
-        status = RCTL_E_NO_ERROR;
-    } while (0);
+            /* the robot took it, and may well have finished while we
+               reconnected; it must not be sent again */
+            if (RCTL_COMMAND_WAIT == state.command)
+            {
+                DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command finished during the drop.\n");
+                break;
+            }
+            else if (command == state.command)
+            {
+                DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command survived the drop; waiting.\n");
+                future.status = RCTL_E_PENDING;
+                status = RCTL_E_PENDING;
+                submitFailed = 0;
+                continue;
+            }
+        }
+        else if (   (command == state.command)
+                 && (future.sequence == state.sequence) )
+        {
+            /* written, but not yet taken (the robot may hold the mutex) */
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command is waiting for the robot.\n");
+            future.status = RCTL_E_PENDING;
+            status = RCTL_E_PENDING;
+            submitFailed = 0;
+            continue;
+        }
+        else if (   !echoes
+                 && !submitFailed
+                 && (RCTL_COMMAND_WAIT == state.command)
+                 && (future.sequence == state.sequence) )
+        {
+            /* the command was written, and the robot has cleared it */
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command finished during the drop.\n");
+            break;
+        }
+        else if (!echoes)
+        {
+            /* otherwise a robot without the sequence protocol cannot show
+               whether it ran the command, so it is never sent again */
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: command lost in the drop; not resubmitting.\n");
+            status = failure;
+            break;
+        }
+        else if (RCTL_COMMAND_WAIT == state.command)
+        {
+            /* the robot never took this sequence number: safe to send */
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: resubmitting a command the robot never saw.\n");
+            robot->connStats.nResubmits++;
+            status = RobotControl_Submit(robot, &future, command, target, NULL, NULL);
+            submitFailed = (RCTL_E_PENDING != status);
+            continue;
+        }
+
+        /* some other command is running, or the robot's state cannot be
+           explained; do not interfere */
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: cannot tell what became of the command!\n");
+        status = RCTL_E_NOT_ACCEPTED;
+        break;
+    }
 
     return (status);
 }
 
-static int RobotControl_sendCommandInfo_noPose( int command )
+/* one status block read: keeps the session open and refreshes the pose */
+static void RobotControl_keepalive( struct ROBOT_CONTROL * robot )
 {
-    struct ROBOT_POSE_3D currentPose;
+    uint16_t block[RCTL_STATUS_BLOCK_SIZE];
+
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = RCTL_COMMAND_WAIT;
+    if (RCTL_STATUS_BLOCK_SIZE == RobotControl_readRegisters(   robot, RCTL_ADDRESS_STATUS_BLOCK,
+                                                                RCTL_STATUS_BLOCK_SIZE,
+                                                                block   ))
+    {
+        RobotControl_poseUpdate(robot, &block[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_STATUS_BLOCK]);
+    }
+    robot->connStats.nKeepalives++;
+    pthread_mutex_unlock(&robot->modbusLock);
+}
+
+/* One read of ACCEPTED through SWEEP_ACK (129-143). */
+static int RobotControl_readSweepStatus(struct ROBOT_CONTROL * robot,
+                                        uint16_t * status   )
+{
+    int nStatus = RCTL_ADDRESS_SWEEP_ACK - RCTL_ADDRESS_ACCEPTED + 1;
+    int nRegisters;
+
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = RCTL_COMMAND_SWEEP;
+    nRegisters = RobotControl_readRegisters(robot, RCTL_ADDRESS_ACCEPTED, nStatus, status);
+    pthread_mutex_unlock(&robot->modbusLock);
+
+    if (nStatus != nRegisters) return (RCTL_E_MODBUS_READ);
+
+    RobotControl_poseUpdate(robot, &status[RCTL_ADDRESS_CURRENT_POSE - RCTL_ADDRESS_ACCEPTED]);
+
+    return (RCTL_E_NO_ERROR);
+}
+
+/* Release a robot left in a sweep: RCTL_SWEEP_ACK_ABORT in SWEEP_ACK makes
+   the robot program lift the probe from its dwell and return the command
+   register to RCTL_COMMAND_WAIT.  The abort goes out on the E-stop
+   connection if the command connection cannot be restored.  Returns
+   RCTL_E_NO_ERROR once the robot has let go of the sweep. */
+static int RobotControl_sweepAbort( struct ROBOT_CONTROL * robot, uint16_t sequence )
+{
+    uint16_t status[RCTL_ADDRESS_SWEEP_ACK - RCTL_ADDRESS_ACCEPTED + 1];
+    struct RCTL_BACKOFF backoff;
+    uint64_t deadline;
+    int nRegisters;
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: aborting the sweep.\n");
+
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = RCTL_COMMAND_SWEEP;
+    nRegisters = RobotControl_writeRegister(robot, RCTL_ADDRESS_SWEEP_ACK, RCTL_SWEEP_ACK_ABORT);
+    pthread_mutex_unlock(&robot->modbusLock);
+
+    if ((1 != nRegisters) && (NULL != robot->modbusEStop))
+    {
+        pthread_mutex_lock(&robot->estopLock);
+        if (1 != modbus_write_register(robot->modbusEStop, RCTL_ADDRESS_SWEEP_ACK, RCTL_SWEEP_ACK_ABORT))
+        {
+            modbus_close(robot->modbusEStop);
+            modbus_connect(robot->modbusEStop);
+            modbus_write_register(robot->modbusEStop, RCTL_ADDRESS_SWEEP_ACK, RCTL_SWEEP_ACK_ABORT);
+        }
+        pthread_mutex_unlock(&robot->estopLock);
+    }
+
+    RobotControl_backoffInit(   &backoff,
+                                RCTL_POLL_BACKOFF_MIN_US,
+                                RCTL_POLL_BACKOFF_MAX_US );
+    deadline = RobotControl_now() + RCTL_SWEEP_ABORT_TIMEOUT_MS * 1000000ULL;
+
+    while (RobotControl_now() < deadline)
+    {
+        if (    (RCTL_E_NO_ERROR == RobotControl_readSweepStatus(robot, status))
+            &&  (   (RCTL_COMMAND_SWEEP != status[RCTL_ADDRESS_COMMAND - RCTL_ADDRESS_ACCEPTED])
+                 || (sequence != status[RCTL_ADDRESS_SEQUENCE - RCTL_ADDRESS_ACCEPTED]))    )
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: sweep aborted; robot released.\n");
+            return (RCTL_E_NO_ERROR);
+        }
+
+        RobotControl_backoffWait(&backoff);
+    }
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: robot did not leave the sweep; it may still be dwelling!\n");
+
+    return (RCTL_E_MODBUS_READ);
+}
+
+/* Write the sweep block, start the sweep and acknowledge each dwell until the
+   robot returns the command register to RCTL_COMMAND_WAIT.  The block is
+   written without claiming the mutex: the robot reads it only once the
+   command has been written.
+
+   A failed read or acknowledgement is retried after reconnecting, resuming
+   from whatever dwell the robot reports; each dwell's callback runs once.
+   If the robot cannot be reached RCTL_SWEEP_RECOVERIES times in a row, or
+   the sweep overruns its deadline, the sweep is aborted (see
+   RobotControl_sweepAbort()) before the error is returned, so the robot is
+   never left waiting for an acknowledgement. */
+static int RobotControl_runSweep( struct RCTL_JOB * job )
+{
+    struct ROBOT_CONTROL * robot = job->robot;
+    uint16_t block[RCTL_ADDRESS_SWEEP_POSES - RCTL_ADDRESS_SWEEP_DWELL
+                    + 3 * RCTL_SWEEP_MAX_WAYPOINTS];
+    uint16_t status[RCTL_ADDRESS_SWEEP_ACK - RCTL_ADDRESS_ACCEPTED + 1];
+    struct RCTL_FUTURE future;
+    struct RCTL_BACKOFF backoff;
+    uint64_t start;
+    uint16_t command;
+    uint16_t dwell;
+    uint16_t visited = 0;   /* last dwell whose callback has run */
+    uint16_t acked = 0;     /* last dwell acknowledged           */
+    uint64_t deadline;
+    int nFailures = 0;
+    int nBlock;
+    int nRegisters;
+    int result;
+
+    if (!RobotControl_CanSweep(robot))
+    {
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: robot program cannot sweep!\n");
+        return (RCTL_E_UNSUPPORTED);
+    }
+
+    nBlock = RCTL_ADDRESS_SWEEP_POSES - RCTL_ADDRESS_SWEEP_DWELL + 3 * job->nWaypoints;
+
+    block[RCTL_ADDRESS_SWEEP_DWELL - RCTL_ADDRESS_SWEEP_DWELL] = 0;
+    block[RCTL_ADDRESS_SWEEP_ACK   - RCTL_ADDRESS_SWEEP_DWELL] = 0;
+    block[RCTL_ADDRESS_SWEEP_COUNT - RCTL_ADDRESS_SWEEP_DWELL] = job->nWaypoints;
+    memcpy( &block[RCTL_ADDRESS_SWEEP_POSES - RCTL_ADDRESS_SWEEP_DWELL],
+            job->waypoints,
+            job->nWaypoints * sizeof(struct ROBOT_POSE_3D) );
+
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = RCTL_COMMAND_SWEEP;
+    robot->txRetries = 0;
+    start = RobotControl_now();
+    nRegisters = modbus_write_registers(robot->modbus,
+                                        RCTL_ADDRESS_SWEEP_DWELL,
+                                        nBlock,
+                                        block );
+    RobotControl_roundTrip(robot, start);
+    pthread_mutex_unlock(&robot->modbusLock);
+    if (nBlock != nRegisters)
+    {
+        RobotControl_recordCompletion(robot, RCTL_COMMAND_SWEEP, start, RCTL_E_MODBUS_WRITE);
+        return (RCTL_E_MODBUS_WRITE);
+    }
+
+    /* a failed submit may still have reached the robot; the status reads
+       below tell (see RCTL_ADDRESS_SEQUENCE) */
+    result = RobotControl_Submit(   robot, &future,
+                                    RCTL_COMMAND_SWEEP,
+                                    &job->waypoints[0],
+                                    NULL,
+                                    NULL );
+    if (RCTL_E_PENDING == result) result = RCTL_E_NO_ERROR;
+
+    RobotControl_backoffInit(   &backoff,
+                                RCTL_POLL_BACKOFF_MIN_US,
+                                RCTL_POLL_BACKOFF_MAX_US );
+    deadline = future.submitNs + job->nWaypoints * RCTL_SWEEP_LEG_TIMEOUT_MS * 1000000ULL;
+
+    /* one read returns the command, sequence and dwell registers */
+    while (1)
+    {
+        if (RobotControl_now() >= deadline)
+        {
+            DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: sweep timed out!\n");
+            result = RCTL_E_TIMEOUT;
+            break;
+        }
+
+        if (RCTL_E_NO_ERROR != RobotControl_readSweepStatus(robot, status))
+        {
+            if (++nFailures > RCTL_SWEEP_RECOVERIES)
+            {
+                result = RCTL_E_MODBUS_READ;
+                break;
+            }
+
+            pthread_mutex_lock(&robot->modbusLock);
+            RobotControl_reconnect(robot);
+            pthread_mutex_unlock(&robot->modbusLock);
+            continue;
+        }
+
+        command = status[RCTL_ADDRESS_COMMAND - RCTL_ADDRESS_ACCEPTED];
+        dwell   = status[RCTL_ADDRESS_SWEEP_DWELL - RCTL_ADDRESS_ACCEPTED];
+
+        /* never taken: the submit failed, and there is nothing to release */
+        if (    (RCTL_COMMAND_WAIT == command)
+            &&  (future.sequence != status[RCTL_ADDRESS_ACCEPTED - RCTL_ADDRESS_ACCEPTED])  )
+        {
+            RobotControl_recordCompletion(robot, RCTL_COMMAND_SWEEP, future.submitNs, RCTL_E_NOT_ACCEPTED);
+            return ((RCTL_E_NO_ERROR != result) ? result : RCTL_E_NOT_ACCEPTED);
+        }
+        result = RCTL_E_NO_ERROR;
+
+        if ((dwell != visited) && (dwell >= 1) && (dwell <= job->nWaypoints))
+        {
+            if (NULL != job->onDwell)
+                job->onDwell(dwell - 1, job->dwellData);
+
+            visited = dwell;
+        }
+
+        if ((dwell == visited) && (visited != acked))
+        {
+            pthread_mutex_lock(&robot->modbusLock);
+            robot->txCommand = RCTL_COMMAND_SWEEP;
+            nRegisters = RobotControl_writeRegister(robot, RCTL_ADDRESS_SWEEP_ACK, visited);
+            pthread_mutex_unlock(&robot->modbusLock);
+            if (1 != nRegisters)
+            {
+                if (++nFailures > RCTL_SWEEP_RECOVERIES)
+                {
+                    result = RCTL_E_MODBUS_WRITE;
+                    break;
+                }
+
+                /* re-read: the robot may have moved on if the write landed */
+                continue;
+            }
+
+            acked = visited;
+
+            /* the next leg starts now; poll from the shortest period again */
+            RobotControl_backoffInit(   &backoff,
+                                        RCTL_POLL_BACKOFF_MIN_US,
+                                        RCTL_POLL_BACKOFF_MAX_US );
+            nFailures = 0;
+            continue;
+        }
+
+        nFailures = 0;
+        if (RCTL_COMMAND_WAIT == command) break;
+
+        RobotControl_backoffWait(&backoff);
+    }
+
+    /* an error from here on leaves the robot mid-sweep; let it go first */
+    if (RCTL_E_NO_ERROR != result)
+        RobotControl_sweepAbort(robot, future.sequence);
+
+    RobotControl_recordCompletion(robot, RCTL_COMMAND_SWEEP, future.submitNs, result);
+
+    return (result);
+}
+
+/* Publish a job's result.  The callback runs before waiters are woken, so
+   it has finished by the time RobotControl_JobWait() returns. */
+static void RobotControl_jobFinish( struct RCTL_JOB * job, int status )
+{
+    struct ROBOT_CONTROL * robot = job->robot;
+
+    if (NULL != job->callback)
+        job->callback(job->command, status, job->userData);
+
+    pthread_mutex_lock(&robot->queueLock);
+    job->status = status;
+    if (job->detached)
+        free(job);
+    else
+        pthread_cond_broadcast(&robot->doneCond);
+    pthread_mutex_unlock(&robot->queueLock);
+}
+
+static void * RobotControl_thread( void * arg )
+{
+    struct ROBOT_CONTROL * robot = arg;
+    struct RCTL_JOB * job;
+    struct timespec deadline;
+    int stopping;
     int status;
 
-    do
+    pthread_mutex_lock(&robot->queueLock);
+    while (1)
     {
-        status = RobotControl_modbusClaim();
-        if (RCTL_E_NO_ERROR != status) break;
+        /* while idle, send a keepalive every RCTL_KEEPALIVE_MS */
+        while (!robot->stop && (NULL == robot->queueHead))
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec  += RCTL_KEEPALIVE_MS / 1000;
+            deadline.tv_nsec += (RCTL_KEEPALIVE_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            if (ETIMEDOUT == pthread_cond_timedwait(&robot->queueCond, &robot->queueLock, &deadline))
+            {
+                if (robot->stop || (NULL != robot->queueHead)) break;
+
+                pthread_mutex_unlock(&robot->queueLock);
+                RobotControl_keepalive(robot);
+                pthread_mutex_lock(&robot->queueLock);
+            }
+        }
 
-        status = RobotControl_getCurrentPose(&currentPose);
-        if (RCTL_E_NO_ERROR != status) break;
+        job = robot->queueHead;
+        if (NULL == job) break;
 
-        status = RobotControl_modbusRelease();
-        if (RCTL_E_NO_ERROR != status) break;
+        robot->queueHead = job->next;
+        if (NULL == robot->queueHead) robot->queueTail = NULL;
 
-        status = RobotControl_sendCommandInfo(command, &currentPose);
-        if (RCTL_E_NO_ERROR != status) break;
+        stopping = robot->stop;
+        pthread_mutex_unlock(&robot->queueLock);
 
-        status = RCTL_E_NO_ERROR;
-    } while (0);
+        /* jobs still queued at shutdown are failed, not executed */
+        if (stopping)
+            status = RCTL_E_SHUTDOWN;
+        else if (RCTL_COMMAND_SWEEP == job->command)
+            status = RobotControl_runSweep(job);
+        else
+            status = RobotControl_sendCommandInfo(  robot, job->command,
+                                                    job->hasPose
+                                                    ? &job->pose
+                                                    : NULL );
+        RobotControl_jobFinish(job, status);
+
+        pthread_mutex_lock(&robot->queueLock);
+    }
+    pthread_mutex_unlock(&robot->queueLock);
+
+    return (NULL);
+}
+
+static struct RCTL_JOB * RobotControl_jobNew(   struct ROBOT_CONTROL * robot,
+                                                uint16_t command,
+                                                struct ROBOT_POSE_3D * pose,
+                                                RCTL_CALLBACK callback,
+                                                void * userData )
+{
+    struct RCTL_JOB * job;
+
+    job = calloc(1, sizeof(struct RCTL_JOB));
+    if (NULL == job) return (NULL);
+
+    job->robot    = robot;
+    job->command  = command;
+    job->callback = callback;
+    job->userData = userData;
+    job->status   = RCTL_E_PENDING;
+    if (NULL != pose)
+    {
+        job->hasPose = 1;
+        job->pose    = *pose;
+    }
+
+    return (job);
+}
+
+static struct RCTL_JOB * RobotControl_jobPush( struct RCTL_JOB * job )
+{
+    struct ROBOT_CONTROL * robot;
+    int running;
+
+    if (NULL == job) return (NULL);
+    robot = job->robot;
+
+    pthread_mutex_lock(&robot->queueLock);
+    running = robot->running && !robot->stop;
+    if (running)
+    {
+        if (NULL == robot->queueTail)
+            robot->queueHead = job;
+        else
+            robot->queueTail->next = job;
+        robot->queueTail = job;
+
+        pthread_cond_signal(&robot->queueCond);
+    }
+    pthread_mutex_unlock(&robot->queueLock);
+
+    if (!running)
+        RobotControl_jobFinish(job, RCTL_E_SHUTDOWN);
+
+    return (job);
+}
+
+static struct RCTL_JOB * RobotControl_enqueue(  struct ROBOT_CONTROL * robot,
+                                                uint16_t command,
+                                                struct ROBOT_POSE_3D * pose,
+                                                RCTL_CALLBACK callback,
+                                                void * userData )
+{
+    return (RobotControl_jobPush(RobotControl_jobNew(robot, command, pose, callback, userData)));
+}
+
+static int RobotControl_runSync(struct ROBOT_CONTROL * robot,
+                                uint16_t command,
+                                struct ROBOT_POSE_3D * pose )
+{
+    struct RCTL_JOB * job;
+    int status;
+
+    job = RobotControl_enqueue(robot, command, pose, NULL, NULL);
+    if (NULL == job) return (RCTL_E_NO_MEMORY);
+
+    status = RobotControl_JobWait(job);
+    RobotControl_JobFree(job);
 
     return (status);
 }
 
-void RobotControl_Init( void )
+/* Fill in the endpoint: an explicit argument, else the environment, else
+   the compiled-in default. */
+static void RobotControl_setEndpoint(   struct ROBOT_CONTROL * robot,
+                                        const char * ip,
+                                        const char * port   )
 {
-    struct timeval responseTimeout;
-    
-    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Initializing Modbus TCP PI.\n");
+    if (NULL == ip)     ip   = getenv(RCTL_ENV_SERVER_IP);
+    if (NULL == ip)     ip   = MODBUS_SERVER_IP;
+    if (NULL == port)   port = getenv(RCTL_ENV_SERVER_PORT);
+    if (NULL == port)   port = MODBUS_SERVER_PORT;
+
+    snprintf(robot->serverIp,   sizeof(robot->serverIp),   "%s", ip);
+    snprintf(robot->serverPort, sizeof(robot->serverPort), "%s", port);
+}
+
+/* Write a fresh sequence number to SEQUENCE alone and wait for the idle
+   loop of a robot program with the sequence protocol to echo it to
+   ACCEPTED.  The command register is not touched, so a robot without the
+   protocol sees nothing.  Returns 1 if the number was echoed. */
+static int RobotControl_probeEcho( struct ROBOT_CONTROL * robot )
+{
+    struct RCTL_COMMAND_STATE state;
+    struct RCTL_BACKOFF backoff;
+    uint64_t deadline;
+    uint16_t probe;
+
+    probe = RobotControl_nextSequence(robot);
+    if (1 != modbus_write_register(robot->modbus, RCTL_ADDRESS_SEQUENCE, probe))
+        return (0);
+
+    RobotControl_backoffInit(   &backoff,
+                                RCTL_POLL_BACKOFF_MIN_US,
+                                RCTL_POLL_BACKOFF_MAX_US );
+    deadline = RobotControl_now() + RCTL_ECHO_PROBE_MS * 1000000ULL;
+
+    do
+    {
+        RobotControl_backoffWait(&backoff);
+        if (RCTL_E_NO_ERROR != RobotControl_getCommand(robot, &state))
+            return (0);
+        if (probe == state.accepted)
+            return (1);
+    } while (RobotControl_now() < deadline);
+
+    /* a robot busy with a command left over from before does not echo
+       either, and cannot be told apart */
+    if (RCTL_COMMAND_WAIT != state.command)
+        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: robot busy during the sequence probe.\n");
+
+    return (0);
+}
+
+static void RobotControl_free( struct ROBOT_CONTROL * robot )
+{
+    if (NULL != robot->modbusEStop)
+    {
+        modbus_close(robot->modbusEStop);
+        modbus_free(robot->modbusEStop);
+    }
+
+    if (NULL != robot->modbus)
+    {
+        modbus_close(robot->modbus);
+        modbus_free(robot->modbus);
+    }
+
+    pthread_mutex_destroy(&robot->modbusLock);
+    pthread_mutex_destroy(&robot->estopLock);
+    pthread_mutex_destroy(&robot->poseLock);
+    pthread_mutex_destroy(&robot->statsLock);
+    pthread_mutex_destroy(&robot->queueLock);
+    pthread_cond_destroy(&robot->queueCond);
+    pthread_cond_destroy(&robot->doneCond);
+
+    free(robot);
+}
+
+struct ROBOT_CONTROL * RobotControl_Init( const char * ip, const char * port )
+{
+    struct ROBOT_CONTROL * robot;
+    pthread_condattr_t condAttr;
+    int result;
+
+    robot = calloc(1, sizeof(struct ROBOT_CONTROL));
+    if (NULL == robot) return (NULL);
+
+    RobotControl_setEndpoint(robot, ip, port);
+    robot->submitMode = RCTL_SUBMIT_PACKED;
+
+    pthread_mutex_init(&robot->modbusLock, NULL);
+    pthread_mutex_init(&robot->estopLock,  NULL);
+    pthread_mutex_init(&robot->poseLock,   NULL);
+    pthread_mutex_init(&robot->statsLock,  NULL);
+    RobotControl_ResetLatency(robot);
+    pthread_mutex_init(&robot->queueLock,  NULL);
+    pthread_cond_init(&robot->doneCond,    NULL);
+
+    /* the keepalive timer runs on CLOCK_MONOTONIC */
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&robot->queueCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+
+    DEBUG_PRINT_LEVEL_FORMAT(G_SYSTEM_LOG, "Initializing Modbus TCP PI (%s:%s).\n",
+                             robot->serverIp, robot->serverPort);
     DEBUG_PRINT_LEVEL_ENTER();
-    
-    g_modbus = modbus_new_tcp_pi(MODBUS_SERVER_IP, MODBUS_SERVER_PORT);
+
+    /* other subsystems may be initializing concurrently, so keep each
+       result here rather than relying on _RV_GET() */
+    robot->modbus = modbus_new_tcp_pi(robot->serverIp, robot->serverPort);
+    result = (NULL == robot->modbus);
     DEBUG_PRINT (   G_SYSTEM_LOG,
                     "Creating libmodbus context....",
-                    NULL == g_modbus,
-                    FAILURE_FORBIDDEN
+                    result,
+                    FAILURE_ALLOWED
                 );
+    if (0 != result)
+    {
+        DEBUG_PRINT_LEVEL_EXIT();
+        RobotControl_free(robot);
+        return (NULL);
+    }
 
+    result = (-1 == modbus_connect(robot->modbus));
     DEBUG_PRINT (   G_SYSTEM_LOG,
                     "Connecting to Modbus server...",
-                    -1 == modbus_connect(g_modbus),
-                    FAILURE_FORBIDDEN
+                    result,
+                    FAILURE_ALLOWED
                 );
     fflush(G_SYSTEM_LOG);
+    if (0 != result)
+    {
+        DEBUG_PRINT_LEVEL_EXIT();
+        RobotControl_free(robot);
+        return (NULL);
+    }
+
+    modbus_set_debug(robot->modbus, NULL != getenv(RCTL_ENV_MODBUS_DEBUG));
+
+    /* continue the robot's sequence, so that no new command can look as if
+       it had already been accepted */
+    if (1 != modbus_read_registers(robot->modbus, RCTL_ADDRESS_ACCEPTED, 1, &robot->sequence))
+        robot->sequence = (uint16_t) RobotControl_now();
+
+    /* notice a dead connection within one response timeout */
+#if LIBMODBUS_VERSION_CHECK(3, 1, 0)
+    modbus_set_response_timeout(robot->modbus, 0, RCTL_RESPONSE_TIMEOUT_US);
+#else
+    {
+        struct timeval responseTimeout = { 0, RCTL_RESPONSE_TIMEOUT_US };
+        modbus_set_response_timeout(robot->modbus, &responseTimeout);
+    }
+#endif
+
+    /* without the sequence protocol, completion is judged the old way */
+    if (NULL != getenv(RCTL_ENV_SEQUENCE_ECHO))
+        robot->echoesSequence = (0 != atoi(getenv(RCTL_ENV_SEQUENCE_ECHO)));
+    else
+        robot->echoesSequence = RobotControl_probeEcho(robot);
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+    fprintf(G_SYSTEM_LOG, "Robot program %s sequence numbers.\n",
+            robot->echoesSequence ? "echoes" : "does not echo");
+
+    /* an emergency stop must not queue behind a motion in progress */
+    robot->modbusEStop = modbus_new_tcp_pi(robot->serverIp, robot->serverPort);
+    result = (NULL == robot->modbusEStop) || (-1 == modbus_connect(robot->modbusEStop));
+    DEBUG_PRINT (   G_SYSTEM_LOG,
+                    "Connecting E-stop context.....",
+                    result,
+                    FAILURE_ALLOWED
+                );
+    if ((NULL != robot->modbusEStop) && (0 != result))
+    {
+        modbus_free(robot->modbusEStop);
+        robot->modbusEStop = NULL;
+    }
 
-    modbus_set_debug(g_modbus, TRUE);
+    result = pthread_create(&robot->thread, NULL, RobotControl_thread, robot);
+    DEBUG_PRINT (   G_SYSTEM_LOG,
+                    "Starting robot thread.........",
+                    result,
+                    FAILURE_ALLOWED
+                );
+    robot->running = (0 == result);
 
     DEBUG_PRINT_LEVEL_EXIT();
+
+    if (!robot->running)
+    {
+        RobotControl_free(robot);
+        return (NULL);
+    }
+
+    return (robot);
 }
 
-void RobotControl_Refresh( void )
+void RobotControl_Refresh( struct ROBOT_CONTROL * robot )
 {
-    uint16_t temp;
-    int nRegisters;
+    RobotControl_keepalive(robot);
+}
+
+int RobotControl_GetPose( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * pose, uint64_t * ageNs )
+{
+    int status = RCTL_E_NO_POSE;
+
+    pthread_mutex_lock(&robot->poseLock);
+    if (0 != robot->poseTime)
+    {
+        *pose = robot->pose;
+        if (NULL != ageNs)
+            *ageNs = RobotControl_now() - robot->poseTime;
+        status = RCTL_E_NO_ERROR;
+    }
+    pthread_mutex_unlock(&robot->poseLock);
+
+    return (status);
+}
+
+void RobotControl_GetConnectionStats( struct ROBOT_CONTROL * robot, struct RCTL_CONNECTION_STATS * stats )
+{
+    pthread_mutex_lock(&robot->modbusLock);
+    *stats = robot->connStats;
+    pthread_mutex_unlock(&robot->modbusLock);
+}
+
+void RobotControl_DumpLatency( struct ROBOT_CONTROL * robot, FILE * fptr )
+{
+    static const char * const names[RCTL_N_COMMANDS] =
+    {
+        [RCTL_COMMAND_WAIT]     = "idle",
+        [RCTL_COMMAND_HOME]     = "home",
+        [RCTL_COMMAND_PHOTO]    = "photo",
+        [RCTL_COMMAND_HERE]     = "here",
+        [RCTL_COMMAND_TEMP]     = "temp",
+        [RCTL_COMMAND_FLIP]     = "flip",
+        [RCTL_COMMAND_DEPOSIT]  = "deposit",
+        [RCTL_COMMAND_SWEEP]    = "sweep"
+    };
+    struct RCTL_LATENCY * latency;
+    int command;
+
+    DEBUG_PRINT_LEVEL(fptr, "");
+    fprintf(fptr, "RobotControl latency (%s:%s):\n", robot->serverIp, robot->serverPort);
+    DEBUG_PRINT_LEVEL_ENTER();
+
+    pthread_mutex_lock(&robot->statsLock);
+    for (command = 0; command < RCTL_N_COMMANDS; command++)
+    {
+        latency = &robot->latency[command];
+        if (0 == latency->roundTripNs.count) continue;
+
+        DEBUG_PRINT_LEVEL(fptr, "");
+        fprintf(fptr, "%s:\n", names[command]);
+        DEBUG_PRINT_LEVEL_ENTER();
+        Histogram_print(&latency->claimNs,      fptr, "claim wait",   1e6, "ms");
+        Histogram_print(&latency->roundTripNs,  fptr, "round trip",   1e6, "ms");
+        Histogram_print(&latency->completionNs, fptr, "completion",   1e6, "ms");
+        Histogram_print(&latency->retries,      fptr, "retries",      1.0, "");
+        DEBUG_PRINT_LEVEL_EXIT();
+    }
+    pthread_mutex_unlock(&robot->statsLock);
+
+    DEBUG_PRINT_LEVEL_EXIT();
+    fflush(fptr);
+}
 
-    nRegisters = modbus_read_registers( g_modbus,
-                                        RCTL_ADDRESS_MUTEX,
-                                        1,
-                                        &temp);
+void RobotControl_GetLatency(   struct ROBOT_CONTROL * robot,
+                                int                    command,
+                                struct RCTL_LATENCY  * latency )
+{
+    pthread_mutex_lock(&robot->statsLock);
+    *latency = robot->latency[command % RCTL_N_COMMANDS];
+    pthread_mutex_unlock(&robot->statsLock);
+}
+
+void RobotControl_ResetLatency( struct ROBOT_CONTROL * robot )
+{
+    int command;
 
-    /* if the read failed because the connection dropped, */
-    if ((1 != nRegisters) && (5 == errno))
+    pthread_mutex_lock(&robot->statsLock);
+    for (command = 0; command < RCTL_N_COMMANDS; command++)
     {
-        DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "RobotControl: UR3 dropped connection.  Reconnecting...\n");
-        modbus_close(g_modbus);
-        modbus_connect(g_modbus);
+        Histogram_init(&robot->latency[command].claimNs);
+        Histogram_init(&robot->latency[command].roundTripNs);
+        Histogram_init(&robot->latency[command].completionNs);
+        Histogram_init(&robot->latency[command].retries);
     }
+    pthread_mutex_unlock(&robot->statsLock);
 }
 
-void RobotControl_Shdn( void )
+void RobotControl_SetModbusDebug( struct ROBOT_CONTROL * robot, int enable )
 {
-    modbus_close(g_modbus);
-    modbus_free(g_modbus);
+    pthread_mutex_lock(&robot->modbusLock);
+    modbus_set_debug(robot->modbus, enable ? TRUE : FALSE);
+    pthread_mutex_unlock(&robot->modbusLock);
+}
+
+void RobotControl_Shdn( struct ROBOT_CONTROL * robot )
+{
+    /* finish the command in progress; fail the rest */
+    if (robot->running)
+    {
+        pthread_mutex_lock(&robot->queueLock);
+        robot->stop = 1;
+        pthread_cond_signal(&robot->queueCond);
+        pthread_mutex_unlock(&robot->queueLock);
+
+        pthread_join(robot->thread, NULL);
+        robot->running = 0;
+    }
+
+    RobotControl_free(robot);
 }
 
-int RobotControl_Home( void )
+int RobotControl_Home( struct ROBOT_CONTROL * robot )
 {
     int status;
     
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Moving robot to home position... ");
-    status = RobotControl_sendCommandInfo_noPose(RCTL_COMMAND_HOME);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_HOME, NULL);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -287,12 +1594,12 @@ int RobotControl_Home( void )
     return (status);
 }
 
-int RobotControl_Photo( void )
+int RobotControl_Photo( struct ROBOT_CONTROL * robot )
 {
     int status;
     
     DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Moving robot to photo position... ");
-    status = RobotControl_sendCommandInfo_noPose(RCTL_COMMAND_PHOTO);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_PHOTO, NULL);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -302,7 +1609,7 @@ int RobotControl_Photo( void )
     return (status);
 }
 
-int RobotControl_Here( struct ROBOT_POSE_3D * targetPose )
+int RobotControl_Here( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose )
 {
     int status;
     
@@ -310,7 +1617,7 @@ int RobotControl_Here( struct ROBOT_POSE_3D * targetPose )
     fprintf(G_SYSTEM_LOG,
             "Moving robot to position at (%d, %d, %d)... ",
             targetPose->x, targetPose->y, targetPose->z );
-    status = RobotControl_sendCommandInfo(RCTL_COMMAND_HERE, targetPose);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_HERE, targetPose);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -320,7 +1627,7 @@ int RobotControl_Here( struct ROBOT_POSE_3D * targetPose )
     return (status);
 }
 
-int RobotControl_Temp( struct ROBOT_POSE_3D * targetPose )
+int RobotControl_Temp( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose )
 {
     int status;
     
@@ -328,7 +1635,7 @@ int RobotControl_Temp( struct ROBOT_POSE_3D * targetPose )
     fprintf(G_SYSTEM_LOG,
             "Moving robot to measure temperature at (%d, %d)... ",
             targetPose->x, targetPose->y);
-    status = RobotControl_sendCommandInfo(RCTL_COMMAND_TEMP, targetPose);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_TEMP, targetPose);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -338,7 +1645,7 @@ int RobotControl_Temp( struct ROBOT_POSE_3D * targetPose )
     return (status);
 }
 
-int RobotControl_Flip( struct ROBOT_POSE_3D * targetPose )
+int RobotControl_Flip( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose )
 {
     int status;
     
@@ -346,7 +1653,7 @@ int RobotControl_Flip( struct ROBOT_POSE_3D * targetPose )
     fprintf(G_SYSTEM_LOG,
             "Moving robot to flip patty at (%d, %d)... ",
             targetPose->x, targetPose->y );
-    status = RobotControl_sendCommandInfo(RCTL_COMMAND_FLIP, targetPose);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_FLIP, targetPose);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -356,7 +1663,7 @@ int RobotControl_Flip( struct ROBOT_POSE_3D * targetPose )
     return (status);
 }
 
-int RobotControl_Deposit( struct ROBOT_POSE_3D * targetPose )
+int RobotControl_Deposit( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose )
 {
     int status;
     
@@ -364,7 +1671,7 @@ int RobotControl_Deposit( struct ROBOT_POSE_3D * targetPose )
     fprintf(G_SYSTEM_LOG,
             "Moving robot to deposit patty at (%d, %d)... ",
             targetPose->x, targetPose->y );
-    status = RobotControl_sendCommandInfo(RCTL_COMMAND_DEPOSIT, targetPose);
+    status = RobotControl_runSync(robot, RCTL_COMMAND_DEPOSIT, targetPose);
     fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
                                         ? "succeeded."
                                         : "failed!",
@@ -374,8 +1681,275 @@ int RobotControl_Deposit( struct ROBOT_POSE_3D * targetPose )
     return (status);
 }
 
-void RobotControl_EStop( void )
+void RobotControl_SetSubmitMode( struct ROBOT_CONTROL * robot, int mode )
+{
+    robot->submitMode = (RCTL_SUBMIT_LEGACY == mode)
+                    ? RCTL_SUBMIT_LEGACY
+                    : RCTL_SUBMIT_PACKED;
+}
+
+int RobotControl_GetSubmitMode( struct ROBOT_CONTROL * robot )
+{
+    return (robot->submitMode);
+}
+
+void RobotControl_SetSequenceEcho( struct ROBOT_CONTROL * robot, int enable )
+{
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->echoesSequence = (0 != enable);
+    pthread_mutex_unlock(&robot->modbusLock);
+}
+
+int RobotControl_GetSequenceEcho( struct ROBOT_CONTROL * robot )
+{
+    int echoes;
+
+    pthread_mutex_lock(&robot->modbusLock);
+    echoes = robot->echoesSequence;
+    pthread_mutex_unlock(&robot->modbusLock);
+
+    return (echoes);
+}
+
+/* the sweep comes with the sequence protocol; see RCTL_ADDRESS_SWEEP_DWELL */
+int RobotControl_CanSweep( struct ROBOT_CONTROL * robot )
+{
+    return (RobotControl_GetSequenceEcho(robot));
+}
+
+int RobotControl_Sweep(    struct ROBOT_CONTROL * robot,
+                            const struct ROBOT_POSE_3D * waypoints,
+                            int                   nWaypoints,
+                            RCTL_DWELL_CALLBACK   onDwell,
+                            void *                dwellData )
+{
+    struct RCTL_JOB * job;
+    int status;
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "");
+    fprintf(G_SYSTEM_LOG, "Sweeping robot through %d waypoints... ", nWaypoints);
+
+    job = RobotControl_SweepAsync(robot, waypoints, nWaypoints, onDwell, dwellData, NULL, NULL);
+    if (NULL == job)
+    {
+        status = RCTL_E_NO_MEMORY;
+    }
+    else
+    {
+        status = RobotControl_JobWait(job);
+        RobotControl_JobFree(job);
+    }
+
+    fprintf(G_SYSTEM_LOG, "%s (%d)\n",  (RCTL_E_NO_ERROR == status)
+                                        ? "succeeded."
+                                        : "failed!",
+                                        status );
+    fflush(G_SYSTEM_LOG);
+
+    return (status);
+}
+
+int RobotControl_Submit(   struct ROBOT_CONTROL * robot,
+                            struct RCTL_FUTURE  * future,
+                            uint16_t              command,
+                            struct ROBOT_POSE_3D * targetPose,
+                            RCTL_CALLBACK         callback,
+                            void                * userData )
+{
+    int status;
+
+    future->robot    = robot;
+    future->submitNs = RobotControl_now();
+    future->command  = command;
+    future->status   = RCTL_E_PENDING;
+    future->callback = callback;
+    future->userData = userData;
+    future->nPolls   = 0;
+    RobotControl_backoffInit(   &future->backoff,
+                                RCTL_POLL_BACKOFF_MIN_US,
+                                RCTL_POLL_BACKOFF_MAX_US );
+
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = command % RCTL_N_COMMANDS;
+    robot->txRetries = 0;
+    future->sequence = RobotControl_nextSequence(robot);
+    if (RCTL_SUBMIT_PACKED == robot->submitMode)
+        status = RobotControl_writeCommandPacked(robot, command, future->sequence, targetPose);
+    else
+        status = RobotControl_writeCommand(robot, command, future->sequence, targetPose);
+    pthread_mutex_unlock(&robot->modbusLock);
+
+    if (RCTL_E_NO_ERROR != status)
+    {
+        RobotControl_complete(future, status);
+        return (status);
+    }
+
+    return (RCTL_E_PENDING);
+}
+
+int RobotControl_Poll( struct RCTL_FUTURE * future )
 {
-    modbus_write_register( g_modbus, RCTL_ADDRESS_ESTOP, 1 );
+    struct ROBOT_CONTROL * robot = future->robot;
+    struct RCTL_COMMAND_STATE state;
+    int echoes;
+    int status;
+
+    if (RCTL_E_PENDING != future->status)
+        return (future->status);
+
+    future->nPolls++;
+    pthread_mutex_lock(&robot->modbusLock);
+    robot->txCommand = future->command % RCTL_N_COMMANDS;
+    status = RobotControl_getCommand(robot, &state);
+    echoes = robot->echoesSequence;
+    pthread_mutex_unlock(&robot->modbusLock);
+
+    /* without the sequence protocol, RCTL_COMMAND_WAIT is all there is */
+    if (RCTL_E_NO_ERROR != status)
+        RobotControl_complete(future, status);
+    else if (RCTL_COMMAND_WAIT == state.command)
+        RobotControl_complete(future,   (!echoes || (future->sequence == state.accepted))
+                                        ? RCTL_E_NO_ERROR
+                                        : RCTL_E_NOT_ACCEPTED   );
+
+    return (future->status);
+}
+
+int RobotControl_Wait( struct RCTL_FUTURE * future )
+{
+    while (RCTL_E_PENDING == RobotControl_Poll(future))
+        RobotControl_backoffWait(&future->backoff);
+
+    return (future->status);
+}
+
+struct RCTL_JOB * RobotControl_HomeAsync( struct ROBOT_CONTROL * robot, RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_HOME, NULL, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_PhotoAsync( struct ROBOT_CONTROL * robot, RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_PHOTO, NULL, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_HereAsync(   struct ROBOT_CONTROL * robot,
+                                            struct ROBOT_POSE_3D * targetPose,
+                                            RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_HERE, targetPose, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_TempAsync(   struct ROBOT_CONTROL * robot,
+                                            struct ROBOT_POSE_3D * targetPose,
+                                            RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_TEMP, targetPose, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_FlipAsync(   struct ROBOT_CONTROL * robot,
+                                            struct ROBOT_POSE_3D * targetPose,
+                                            RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_FLIP, targetPose, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_DepositAsync(struct ROBOT_CONTROL * robot,
+                                            struct ROBOT_POSE_3D * targetPose,
+                                            RCTL_CALLBACK callback, void * userData )
+{
+    return (RobotControl_enqueue(robot, RCTL_COMMAND_DEPOSIT, targetPose, callback, userData));
+}
+
+struct RCTL_JOB * RobotControl_SweepAsync(  struct ROBOT_CONTROL * robot,
+                                            const struct ROBOT_POSE_3D * waypoints,
+                                            int nWaypoints,
+                                            RCTL_DWELL_CALLBACK onDwell, void * dwellData,
+                                            RCTL_CALLBACK callback, void * userData )
+{
+    struct RCTL_JOB * job;
+
+    job = RobotControl_jobNew(robot, RCTL_COMMAND_SWEEP, NULL, callback, userData);
+    if (NULL == job) return (NULL);
+
+    if ((nWaypoints < 1) || (nWaypoints > RCTL_SWEEP_MAX_WAYPOINTS))
+    {
+        RobotControl_jobFinish(job, RCTL_E_RANGE);
+        return (job);
+    }
+
+    job->nWaypoints = nWaypoints;
+    job->onDwell    = onDwell;
+    job->dwellData  = dwellData;
+    memcpy(job->waypoints, waypoints, nWaypoints * sizeof(struct ROBOT_POSE_3D));
+
+    return (RobotControl_jobPush(job));
+}
+
+int RobotControl_JobPoll( struct RCTL_JOB * job )
+{
+    struct ROBOT_CONTROL * robot = job->robot;
+    int status;
+
+    pthread_mutex_lock(&robot->queueLock);
+    status = job->status;
+    pthread_mutex_unlock(&robot->queueLock);
+
+    return (status);
+}
+
+int RobotControl_JobWait( struct RCTL_JOB * job )
+{
+    struct ROBOT_CONTROL * robot = job->robot;
+    int status;
+
+    pthread_mutex_lock(&robot->queueLock);
+    while (RCTL_E_PENDING == job->status)
+        pthread_cond_wait(&robot->doneCond, &robot->queueLock);
+    status = job->status;
+    pthread_mutex_unlock(&robot->queueLock);
+
+    return (status);
+}
+
+void RobotControl_JobFree( struct RCTL_JOB * job )
+{
+    struct ROBOT_CONTROL * robot;
+    int pending;
+
+    if (NULL == job) return;
+    robot = job->robot;
+
+    /* a pending job is freed by the robot thread when it completes */
+    pthread_mutex_lock(&robot->queueLock);
+    pending = (RCTL_E_PENDING == job->status);
+    job->detached = pending;
+    pthread_mutex_unlock(&robot->queueLock);
+
+    if (!pending)
+        free(job);
+}
+
+void RobotControl_EStop( struct ROBOT_CONTROL * robot )
+{
+    if (NULL != robot->modbusEStop)
+    {
+        pthread_mutex_lock(&robot->estopLock);
+        if (1 != modbus_write_register( robot->modbusEStop, RCTL_ADDRESS_ESTOP, 1 ))
+        {
+            /* one immediate reconnect; no backoff for an emergency stop */
+            modbus_close(robot->modbusEStop);
+            modbus_connect(robot->modbusEStop);
+            modbus_write_register( robot->modbusEStop, RCTL_ADDRESS_ESTOP, 1 );
+        }
+        pthread_mutex_unlock(&robot->estopLock);
+    }
+    else
+    {
+        pthread_mutex_lock(&robot->modbusLock);
+        modbus_write_register( robot->modbus, RCTL_ADDRESS_ESTOP, 1 );
+        pthread_mutex_unlock(&robot->modbusLock);
+    }
 }
 
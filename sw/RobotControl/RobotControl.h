@@ -16,14 +16,31 @@ controller.
 #include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <modbus.h>
 
 #include "../DEBUG_PRINT.h"
+#include "../Histogram.h"
 
 #define MODBUS_SERVER_IP        "192.168.10.10"
 #define MODBUS_SERVER_PORT      "502"
 
+/* override the endpoint above at run time, e.g. to use RobotSim, when
+   RobotControl_Init() is not given one */
+#define RCTL_ENV_SERVER_IP      "RCTL_SERVER_IP"
+#define RCTL_ENV_SERVER_PORT    "RCTL_SERVER_PORT"
+#define RCTL_ENDPOINT_MAX       64
+
+/* set (to anything) to have libmodbus dump every frame to stdout */
+#define RCTL_ENV_MODBUS_DEBUG   "RCTL_MODBUS_DEBUG"
+
+/* "1" or "0" declares whether the robot program echoes sequence numbers
+   (see RCTL_ADDRESS_SEQUENCE), skipping the probe made at Init */
+#define RCTL_ENV_SEQUENCE_ECHO  "RCTL_SEQUENCE_ECHO"
+
 #define RCTL_E_NO_ERROR         ( 0)
 #define RCTL_E_MODBUS_READ      (-1)
 #define RCTL_E_MODBUS_WRITE     (-2)
@@ -32,17 +49,104 @@ controller.
 #define RCTL_E_MODBUS_CLAIM_R   (-5)
 #define RCTL_E_MODBUS_CLAIM_W   (-6)
 #define RCTL_E_MODBUS_RELEASE   (-7)
+#define RCTL_E_PENDING          (-8)
+#define RCTL_E_SHUTDOWN         (-9)
+#define RCTL_E_NO_MEMORY        (-10)
+#define RCTL_E_RANGE            (-11)
+#define RCTL_E_NO_POSE          (-12)
+#define RCTL_E_NOT_ACCEPTED     (-13)
+#define RCTL_E_TIMEOUT          (-14)
+#define RCTL_E_UNSUPPORTED      (-15)
+#define RCTL_E_CLEARED          (-16)
 
 #define RCTL_USLEEP_PERIOD      10000
 
+/* adaptive backoff bounds (microseconds) for the mutex claim loop and for
+   completion polling; each wait doubles the previous one up to the maximum */
+#define RCTL_CLAIM_BACKOFF_MIN_US   500
+#define RCTL_CLAIM_BACKOFF_MAX_US   RCTL_USLEEP_PERIOD
+#define RCTL_POLL_BACKOFF_MIN_US    2000
+#define RCTL_POLL_BACKOFF_MAX_US    50000
+
+/* connection management: the robot thread sends a keepalive read after
+   RCTL_KEEPALIVE_MS idle, and a dropped connection is re-established with
+   up to RCTL_RECONNECT_ATTEMPTS tries, RCTL_RECONNECT_MIN_MS apart at first
+   and doubling up to RCTL_RECONNECT_MAX_MS */
+#define RCTL_KEEPALIVE_MS           1000
+#define RCTL_RESPONSE_TIMEOUT_US    500000
+#define RCTL_RECONNECT_ATTEMPTS     8
+#define RCTL_RECONNECT_MIN_MS       50
+#define RCTL_RECONNECT_MAX_MS       2000
+#define RCTL_READ_RETRIES           2
+#define RCTL_RESUBMIT_MAX           2
+#define RCTL_ECHO_PROBE_MS          500
+
+/* the pose shadow is used in place of a pose read while younger than this;
+   idle keepalives refresh it every RCTL_KEEPALIVE_MS */
+#define RCTL_POSE_SHADOW_MAX_AGE_MS (2 * RCTL_KEEPALIVE_MS)
+
 /* UR3 general purpose addresses reside in 128-255 */
 #define RCTL_ADDRESS_MUTEX          128
 
+/* Every command is written with a new, non-zero sequence number in
+   SEQUENCE.  A robot program that implements the sequence protocol copies
+   SEQUENCE to ACCEPTED when it takes a command from the command register
+   (to run it or to reject it), and also on every pass of its idle loop
+   (command register RCTL_COMMAND_WAIT, mutex free).  A command register of
+   RCTL_COMMAND_WAIT then means the command is finished only if ACCEPTED
+   holds its sequence number; otherwise the robot never saw it.
+
+   RobotControl_Init() probes for the protocol by writing a fresh value to
+   SEQUENCE alone and waiting up to RCTL_ECHO_PROBE_MS for the idle loop to
+   echo it.  The stock UR3 program does not, so for it a command register
+   of RCTL_COMMAND_WAIT simply means done, ACCEPTED is never consulted and
+   a command interrupted by a dropped connection is never resubmitted. */
+#define RCTL_ADDRESS_ACCEPTED       129
 #define RCTL_ADDRESS_COMMAND        130
+#define RCTL_ADDRESS_SEQUENCE       131
 #define RCTL_ADDRESS_TARGET_POSE    132
 #define RCTL_ADDRESS_CURRENT_POSE   135
 #define RCTL_ADDRESS_ESTOP          141
 
+/* Sweep block, used by RCTL_COMMAND_SWEEP.  The robot visits each waypoint
+   in order; on arrival it writes the waypoint's index + 1 to SWEEP_DWELL and
+   holds still until the same value is written back to SWEEP_ACK.  Writing
+   RCTL_SWEEP_ACK_ABORT to SWEEP_ACK instead ends the sweep where it is:
+   the robot lifts the probe and returns the command register to
+   RCTL_COMMAND_WAIT.  The sweep is part of the sequence protocol: a robot
+   that does not echo sequence numbers is assumed not to implement it, and
+   RCTL_COMMAND_SWEEP fails with RCTL_E_UNSUPPORTED. */
+#define RCTL_ADDRESS_SWEEP_DWELL    142
+#define RCTL_ADDRESS_SWEEP_ACK      143
+#define RCTL_ADDRESS_SWEEP_COUNT    144
+#define RCTL_ADDRESS_SWEEP_POSES    145
+#define RCTL_SWEEP_MAX_WAYPOINTS    16
+#define RCTL_SWEEP_ACK_ABORT        0xFFFF
+
+/* a sweep is aborted after this many failed reads or acknowledgements in a
+   row (each after a full reconnect), or if it is still running after
+   RCTL_SWEEP_LEG_TIMEOUT_MS per waypoint (legs and dwells together), and
+   the abort waits RCTL_SWEEP_ABORT_TIMEOUT_MS for the robot to let go */
+#define RCTL_SWEEP_RECOVERIES       3
+#define RCTL_SWEEP_LEG_TIMEOUT_MS   15000
+#define RCTL_SWEEP_ABORT_TIMEOUT_MS 10000
+
+/* Contiguous blocks used by the packed submission path: the status block
+   covers the mutex through the current pose (128-137), and the submit block
+   covers the command, sequence and target pose (130-134).  The submit
+   block leaves the mutex and ACCEPTED to the robot. */
+#define RCTL_ADDRESS_STATUS_BLOCK   RCTL_ADDRESS_MUTEX
+#define RCTL_STATUS_BLOCK_SIZE      (RCTL_ADDRESS_CURRENT_POSE + 3 - RCTL_ADDRESS_MUTEX)
+#define RCTL_ADDRESS_SUBMIT_BLOCK   RCTL_ADDRESS_COMMAND
+#define RCTL_SUBMIT_BLOCK_SIZE      (RCTL_ADDRESS_TARGET_POSE + 3 - RCTL_ADDRESS_COMMAND)
+
+#define RCTL_SUBMIT_LEGACY      0   /* claim, write pose, write command, release */
+#define RCTL_SUBMIT_PACKED      1   /* status read + one FC23 write/read        */
+
+/* times a packed submit is repeated after the robot cleared it under the
+   mutex (see RobotControl_writeCommandPacked()) */
+#define RCTL_PACKED_REWRITES    2
+
 #define RCTL_COMMAND_WAIT      0
 #define RCTL_COMMAND_HOME      1
 #define RCTL_COMMAND_PHOTO     2
@@ -50,6 +154,8 @@ controller.
 #define RCTL_COMMAND_TEMP      4
 #define RCTL_COMMAND_FLIP      5
 #define RCTL_COMMAND_DEPOSIT   6
+#define RCTL_COMMAND_SWEEP     7
+#define RCTL_N_COMMANDS        (RCTL_COMMAND_SWEEP + 1)
 
 struct ROBOT_POSE_3D
 {
@@ -58,18 +164,166 @@ struct ROBOT_POSE_3D
     int16_t z;
 };
 
-void    RobotControl_Init   ( void );
-void    RobotControl_Refresh( void );
-void    RobotControl_Shdn   ( void );
+/* one robot: its connections, command queue and thread; see RobotControl.c */
+struct ROBOT_CONTROL;
+
+struct RCTL_CONNECTION_STATS
+{
+    unsigned long   nKeepalives;
+    unsigned long   nReconnects;
+    unsigned long   nRetries;       /* reads retried after a reconnect */
+    unsigned long   nResubmits;     /* commands the robot never saw, resent */
+};
+
+/* Latency of one command type.  Modbus round trips made while idle (the
+   keepalive) are charged to RCTL_COMMAND_WAIT. */
+struct RCTL_LATENCY
+{
+    struct HISTOGRAM    claimNs;        /* submit until the mutex is ours    */
+    struct HISTOGRAM    roundTripNs;    /* each Modbus request and response  */
+    struct HISTOGRAM    completionNs;   /* submit until the robot is done    */
+    struct HISTOGRAM    retries;        /* busy mutex reads and read retries */
+};
+
+typedef void (*RCTL_CALLBACK)(uint16_t command, int status, void * userData);
+
+/* called while the robot dwells at waypoint index of a sweep */
+typedef void (*RCTL_DWELL_CALLBACK)(int index, void * userData);
+
+struct RCTL_BACKOFF
+{
+    unsigned int delayUs;
+    unsigned int minUs;
+    unsigned int maxUs;
+};
+
+/* Completion future for a submitted command.  status stays RCTL_E_PENDING
+   until the robot returns the command register to RCTL_COMMAND_WAIT having
+   accepted the command (RCTL_E_NOT_ACCEPTED if it did not; a robot without
+   the sequence protocol is taken to have accepted it), or a Modbus
+   error occurs; the callback, if any, runs exactly once at that
+   point from whichever thread observed the completion. */
+struct RCTL_FUTURE
+{
+    struct ROBOT_CONTROL * robot;
+    uint16_t            command;
+    uint16_t            sequence;
+    int                 status;
+    RCTL_CALLBACK       callback;
+    void              * userData;
+    struct RCTL_BACKOFF backoff;
+    unsigned int        nPolls;
+    uint64_t            submitNs;
+};
+
+/* handle for a command queued to the robot thread; see RobotControl.c */
+struct RCTL_JOB;
+
+/*  RobotControl_Init( ip, port )
+ *  Connects to the robot at ip:port and starts its robot thread.  A NULL ip
+ *  or port is taken from the environment (RCTL_ENV_SERVER_IP/PORT), or else
+ *  from MODBUS_SERVER_IP/PORT.  Returns the robot's handle, or NULL if it
+ *  could not be reached.
+ */
+struct ROBOT_CONTROL * RobotControl_Init( const char * ip, const char * port );
+
+void    RobotControl_Refresh( struct ROBOT_CONTROL * robot );
+void    RobotControl_GetConnectionStats(    struct ROBOT_CONTROL *          robot,
+                                            struct RCTL_CONNECTION_STATS *  stats );
+
+/*  RobotControl_GetPose( robot, pose, ageNs )
+ *  Copies the last known current pose, without any Modbus traffic, and its
+ *  age in nanoseconds if ageNs is not NULL.  Returns RCTL_E_NO_POSE if the
+ *  pose has never been read.
+ */
+int     RobotControl_GetPose(   struct ROBOT_CONTROL *  robot,
+                                struct ROBOT_POSE_3D *  pose,
+                                uint64_t *              ageNs );
+void    RobotControl_Shdn   ( struct ROBOT_CONTROL * robot );
+
+int     RobotControl_Home   ( struct ROBOT_CONTROL * robot );
+int     RobotControl_Photo  ( struct ROBOT_CONTROL * robot );
+int     RobotControl_Here   ( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose );
+int     RobotControl_Temp   ( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose );
+int     RobotControl_Flip   ( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose );
+int     RobotControl_Deposit( struct ROBOT_CONTROL * robot, struct ROBOT_POSE_3D * targetPose );
+int     RobotControl_Sweep  ( struct ROBOT_CONTROL *        robot,
+                              const struct ROBOT_POSE_3D *  waypoints,
+                              int                   nWaypoints,
+                              RCTL_DWELL_CALLBACK   onDwell,
+                              void *                dwellData );
+
+/*  RobotControl_DumpLatency( robot, fptr )
+ *  Prints the claim wait, round trip, completion and retry histograms of
+ *  every command type used so far.  RobotControl_GetLatency() copies one
+ *  command type's histograms instead.
+ */
+void    RobotControl_DumpLatency ( struct ROBOT_CONTROL * robot, FILE * fptr );
+void    RobotControl_GetLatency  (  struct ROBOT_CONTROL * robot,
+                                    int                    command,
+                                    struct RCTL_LATENCY  * latency );
+void    RobotControl_ResetLatency( struct ROBOT_CONTROL * robot );
+
+/* libmodbus frame dumps; off unless RCTL_ENV_MODBUS_DEBUG is set at Init */
+void    RobotControl_SetModbusDebug( struct ROBOT_CONTROL * robot, int enable );
+
+void    RobotControl_SetSubmitMode( struct ROBOT_CONTROL * robot, int mode );
+int     RobotControl_GetSubmitMode( struct ROBOT_CONTROL * robot );
+
+/*  RobotControl_SetSequenceEcho( robot, enable )
+ *  Overrides the result of the sequence protocol probe made at Init (see
+ *  RCTL_ADDRESS_SEQUENCE); RobotControl_GetSequenceEcho() returns it.
+ */
+void    RobotControl_SetSequenceEcho( struct ROBOT_CONTROL * robot, int enable );
+int     RobotControl_GetSequenceEcho( struct ROBOT_CONTROL * robot );
+
+/* non-zero if the robot program implements RCTL_COMMAND_SWEEP */
+int     RobotControl_CanSweep( struct ROBOT_CONTROL * robot );
+
+/*  The future remembers its robot, so Poll and Wait take only the future. */
+int     RobotControl_Submit ( struct ROBOT_CONTROL * robot,
+                              struct RCTL_FUTURE  * future,
+                              uint16_t              command,
+                              struct ROBOT_POSE_3D * targetPose,
+                              RCTL_CALLBACK         callback,
+                              void                * userData );
+int     RobotControl_Poll   ( struct RCTL_FUTURE  * future );
+int     RobotControl_Wait   ( struct RCTL_FUTURE  * future );
+
+/*  Asynchronous variants.  Each queues the command to the robot's thread
+ *  and returns immediately with a job handle (NULL if out of memory).  The
+ *  pose is copied, so it need not outlive the call.  The callback, if not
+ *  NULL, runs on the robot thread when the command completes.  Every handle
+ *  must be released with RobotControl_JobFree(), which may be called before
+ *  the job completes.
+ */
+struct RCTL_JOB * RobotControl_HomeAsync   ( struct ROBOT_CONTROL * robot,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_PhotoAsync  ( struct ROBOT_CONTROL * robot,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_HereAsync   ( struct ROBOT_CONTROL * robot,
+                                             struct ROBOT_POSE_3D * targetPose,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_TempAsync   ( struct ROBOT_CONTROL * robot,
+                                             struct ROBOT_POSE_3D * targetPose,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_FlipAsync   ( struct ROBOT_CONTROL * robot,
+                                             struct ROBOT_POSE_3D * targetPose,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_DepositAsync( struct ROBOT_CONTROL * robot,
+                                             struct ROBOT_POSE_3D * targetPose,
+                                             RCTL_CALLBACK callback, void * userData );
+struct RCTL_JOB * RobotControl_SweepAsync  ( struct ROBOT_CONTROL * robot,
+                                             const struct ROBOT_POSE_3D * waypoints,
+                                             int nWaypoints,
+                                             RCTL_DWELL_CALLBACK onDwell, void * dwellData,
+                                             RCTL_CALLBACK callback, void * userData );
 
-int     RobotControl_Home   ( void );
-int     RobotControl_Photo  ( void );
-int     RobotControl_Here   ( struct ROBOT_POSE_3D * targetPose );
-int     RobotControl_Temp   ( struct ROBOT_POSE_3D * targetPose );
-int     RobotControl_Flip   ( struct ROBOT_POSE_3D * targetPose );
-int     RobotControl_Deposit( struct ROBOT_POSE_3D * targetPose );
+int     RobotControl_JobPoll( struct RCTL_JOB * job );
+int     RobotControl_JobWait( struct RCTL_JOB * job );
+void    RobotControl_JobFree( struct RCTL_JOB * job );
 
-void    RobotControl_EStop  ( void );
+void    RobotControl_EStop  ( struct ROBOT_CONTROL * robot );
 
 #endif /* ROBOT_CONTROL_H */
 
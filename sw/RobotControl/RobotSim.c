@@ -0,0 +1,537 @@
+
+/*
+File:   RobotSim.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements a stand-alone simulator of the UR3 side of the Modbus
+protocol used by RobotControl.c, so that the robot API, the command queue
+and the recipe scheduler can be exercised and benchmarked without a robot.
+
+It serves the register map in RobotControl.h on a libmodbus TCP server and
+behaves like the program running on the robot:
+
+    - When the command register (130) is non-zero and the mutex (128) is
+      free, it starts a "motion" lasting the configured time for that
+      command, and copies the command's sequence number (131) to the
+      accepted register (129).  A rejected command is accepted too.  While
+      idle, it copies the sequence number on every step, which is what
+      RobotControl_Init() probes for.
+    - When the motion ends, the current pose (135-137) becomes the target
+      pose (132-134), or the home/photo pose, and the command register is
+      returned to RCTL_COMMAND_WAIT.
+    - A sweep (RCTL_COMMAND_SWEEP) moves to each waypoint in the sweep
+      block in turn, taking the sweep time per leg, and at each one sets
+      the dwell register and waits for the matching acknowledgement, or
+      for RCTL_SWEEP_ACK_ABORT, which ends the sweep.
+    - A non-zero E-stop register (141) aborts the motion in progress and
+      clears the command register; no new command is started until the
+      E-stop register is cleared.
+
+Any number of clients may be connected at once (RobotControl uses one
+connection for commands and another for the E-stop).
+
+With -n the simulator runs the stock UR3 program instead: 129 is never
+written and a sweep is ignored like any unknown command, so RobotControl
+falls back to taking RCTL_COMMAND_WAIT as done.
+
+Faults can be injected to exercise error handling: a fixed reply latency,
+random exception replies, random dropped connections, and a period after
+each motion during which the robot holds the mutex.
+
+Build and run, e.g.:
+
+    gcc -std=gnu99 -O2 -o RobotSim RobotSim.c -lmodbus
+    ./RobotSim -p 1502 -T 0.1
+
+and point RobotControl at it with
+
+    RCTL_SERVER_IP=127.0.0.1 RCTL_SERVER_PORT=1502 ./app
+
+or RobotControl_Init("127.0.0.1", "1502").  Several simulators on different
+ports stand in for several robots.
+On SIGINT the simulator prints request and command counts and exits.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include <modbus.h>
+
+#include "RobotControl.h"
+
+#define ROBOT_SIM_DEFAULT_ADDRESS   "127.0.0.1"
+#define ROBOT_SIM_DEFAULT_PORT      "1502"
+#define ROBOT_SIM_MAX_CLIENTS       8
+#define ROBOT_SIM_N_REGISTERS       256
+#define ROBOT_SIM_N_COMMANDS        (RCTL_COMMAND_SWEEP + 1)
+#define ROBOT_SIM_N_FUNCTIONS       32
+
+struct ROBOT_SIM_CONFIG
+{
+    const char *    address;
+    const char *    port;
+    double          durationMs[ROBOT_SIM_N_COMMANDS];
+    double          timeScale;
+    unsigned int    latencyUs;
+    double          exceptionRate;
+    double          dropRate;
+    double          mutexHoldMs;
+    int             noSequence;
+    int             verbose;
+};
+
+struct ROBOT_SIM_STATS
+{
+    unsigned long   nRequests[ROBOT_SIM_N_FUNCTIONS];
+    unsigned long   nCompleted[ROBOT_SIM_N_COMMANDS];
+    unsigned long   nExceptions;
+    unsigned long   nDropped;
+    unsigned long   nAborted;
+    unsigned long   nConnections;
+};
+
+static const struct ROBOT_POSE_3D g_homePose  = {    0, -250, 300 };
+static const struct ROBOT_POSE_3D g_photoPose = {    0, -150, 450 };
+
+static const char * const g_commandNames[ROBOT_SIM_N_COMMANDS] =
+{
+    "wait", "home", "photo", "here", "temp", "flip", "deposit", "sweep"
+};
+
+static volatile sig_atomic_t    g_quit = 0;
+
+static modbus_mapping_t *       g_map;
+static struct ROBOT_SIM_CONFIG  g_config;
+static struct ROBOT_SIM_STATS   g_stats;
+
+/* motion in progress; 0 == idle */
+static uint16_t                 g_moving        = RCTL_COMMAND_WAIT;
+static double                   g_motionEnd     = 0.0;
+static double                   g_mutexRelease  = 0.0;
+
+/* sweep in progress: current waypoint, and whether the robot is dwelling */
+static int                      g_sweepIndex    = 0;
+static int                      g_sweepDwelling = 0;
+
+
+static double RobotSim_now( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec + now.tv_nsec * 1e-9);
+}
+
+static int RobotSim_chance( double probability )
+{
+    return ((probability > 0.0) && (drand48() < probability));
+}
+
+static void RobotSim_onSignal( int signum )
+{
+    (void) signum;
+    g_quit = 1;
+}
+
+static void RobotSim_setPose(   int address,
+                                const struct ROBOT_POSE_3D * pose )
+{
+    g_map->tab_registers[address + 0] = (uint16_t) pose->x;
+    g_map->tab_registers[address + 1] = (uint16_t) pose->y;
+    g_map->tab_registers[address + 2] = (uint16_t) pose->z;
+}
+
+/* Advance the simulated robot to time now; returns seconds until the next
+   event, or a negative number if nothing is scheduled. */
+static double RobotSim_step( double now )
+{
+    uint16_t * reg = g_map->tab_registers;
+    uint16_t command;
+    double next = -1.0;
+
+    if ((0.0 != g_mutexRelease) && (now >= g_mutexRelease))
+    {
+        reg[RCTL_ADDRESS_MUTEX] = 0;
+        g_mutexRelease = 0.0;
+    }
+
+    if (reg[RCTL_ADDRESS_ESTOP] && (RCTL_COMMAND_WAIT != g_moving))
+    {
+        fprintf(stderr, "RobotSim: E-stop during %s.\n", g_commandNames[g_moving]);
+        g_stats.nAborted++;
+        g_moving = RCTL_COMMAND_WAIT;
+        reg[RCTL_ADDRESS_COMMAND] = RCTL_COMMAND_WAIT;
+    }
+
+    if ((RCTL_COMMAND_SWEEP == g_moving) && (now >= g_motionEnd))
+    {
+        int nWaypoints = reg[RCTL_ADDRESS_SWEEP_COUNT];
+
+        if (!g_sweepDwelling)
+        {
+            /* arrived at the waypoint; wait for the acknowledgement */
+            memcpy( &reg[RCTL_ADDRESS_CURRENT_POSE],
+                    &reg[RCTL_ADDRESS_SWEEP_POSES + 3 * g_sweepIndex],
+                    sizeof(struct ROBOT_POSE_3D) );
+            reg[RCTL_ADDRESS_SWEEP_DWELL] = g_sweepIndex + 1;
+            g_sweepDwelling = 1;
+        }
+        else if (RCTL_SWEEP_ACK_ABORT == reg[RCTL_ADDRESS_SWEEP_ACK])
+        {
+            /* lift the probe and give up the rest of the sweep */
+            fprintf(stderr, "RobotSim: sweep aborted at waypoint %d.\n", g_sweepIndex + 1);
+            g_stats.nAborted++;
+            g_sweepDwelling = 0;
+            g_sweepIndex = nWaypoints;
+        }
+        else if (reg[RCTL_ADDRESS_SWEEP_ACK] == g_sweepIndex + 1)
+        {
+            g_sweepDwelling = 0;
+            if (++g_sweepIndex < nWaypoints)
+                g_motionEnd = now + g_config.durationMs[RCTL_COMMAND_SWEEP]
+                                    * g_config.timeScale * 1e-3;
+        }
+
+        /* not finished until the last dwell is acknowledged */
+        if (g_sweepDwelling || (g_sweepIndex < nWaypoints))
+            return ((g_sweepDwelling) ? 1e-3 : g_motionEnd - now);
+    }
+
+    if ((RCTL_COMMAND_WAIT != g_moving) && (now >= g_motionEnd))
+    {
+        if (RCTL_COMMAND_HOME == g_moving)
+            RobotSim_setPose(RCTL_ADDRESS_CURRENT_POSE, &g_homePose);
+        else if (RCTL_COMMAND_PHOTO == g_moving)
+            RobotSim_setPose(RCTL_ADDRESS_CURRENT_POSE, &g_photoPose);
+        else if (RCTL_COMMAND_SWEEP == g_moving)
+            ;   /* already at the last waypoint */
+        else
+            memcpy( &reg[RCTL_ADDRESS_CURRENT_POSE],
+                    &reg[RCTL_ADDRESS_TARGET_POSE],
+                    sizeof(struct ROBOT_POSE_3D) );
+
+        /* the robot claims the mutex to clear the command */
+        if (g_config.mutexHoldMs > 0.0)
+        {
+            reg[RCTL_ADDRESS_MUTEX] = 1;
+            g_mutexRelease = now + g_config.mutexHoldMs * 1e-3;
+        }
+        reg[RCTL_ADDRESS_COMMAND] = RCTL_COMMAND_WAIT;
+
+        if (g_config.verbose)
+            fprintf(stderr, "RobotSim: %s done.\n", g_commandNames[g_moving]);
+        g_stats.nCompleted[g_moving]++;
+        g_moving = RCTL_COMMAND_WAIT;
+    }
+
+    command = reg[RCTL_ADDRESS_COMMAND];
+    if (    (RCTL_COMMAND_WAIT == g_moving)
+        &&  (RCTL_COMMAND_WAIT == command)
+        &&  !reg[RCTL_ADDRESS_MUTEX]
+        &&  !g_config.noSequence    )
+    {
+        /* the idle loop echoes the sequence number too */
+        reg[RCTL_ADDRESS_ACCEPTED] = reg[RCTL_ADDRESS_SEQUENCE];
+    }
+
+    if (    (RCTL_COMMAND_WAIT == g_moving)
+        &&  (RCTL_COMMAND_WAIT != command)
+        &&  !reg[RCTL_ADDRESS_MUTEX]
+        &&  !reg[RCTL_ADDRESS_ESTOP]    )
+    {
+        if (!g_config.noSequence)
+            reg[RCTL_ADDRESS_ACCEPTED] = reg[RCTL_ADDRESS_SEQUENCE];
+
+        if ((RCTL_COMMAND_SWEEP == command) && g_config.noSequence)
+        {
+            fprintf(stderr, "RobotSim: unknown command %u.\n", command);
+            reg[RCTL_ADDRESS_COMMAND] = RCTL_COMMAND_WAIT;
+        }
+        else if (   (RCTL_COMMAND_SWEEP == command)
+            &&  (   (reg[RCTL_ADDRESS_SWEEP_COUNT] < 1)
+                 || (reg[RCTL_ADDRESS_SWEEP_COUNT] > RCTL_SWEEP_MAX_WAYPOINTS)) )
+        {
+            fprintf(stderr, "RobotSim: bad sweep count %u.\n", reg[RCTL_ADDRESS_SWEEP_COUNT]);
+            reg[RCTL_ADDRESS_COMMAND] = RCTL_COMMAND_WAIT;
+        }
+        else if (command < ROBOT_SIM_N_COMMANDS)
+        {
+            g_moving = command;
+            g_sweepIndex = 0;
+            g_sweepDwelling = 0;
+            g_motionEnd = now + g_config.durationMs[command]
+                                * g_config.timeScale * 1e-3;
+            if (g_config.verbose)
+                fprintf(stderr, "RobotSim: %s to (%d, %d, %d)...\n",
+                        g_commandNames[command],
+                        (int16_t) reg[RCTL_ADDRESS_TARGET_POSE + 0],
+                        (int16_t) reg[RCTL_ADDRESS_TARGET_POSE + 1],
+                        (int16_t) reg[RCTL_ADDRESS_TARGET_POSE + 2] );
+        }
+        else
+        {
+            /* the robot program ignores unknown commands */
+            fprintf(stderr, "RobotSim: unknown command %u.\n", command);
+            reg[RCTL_ADDRESS_COMMAND] = RCTL_COMMAND_WAIT;
+        }
+    }
+
+    if (RCTL_COMMAND_WAIT != g_moving)
+        next = g_motionEnd - now;
+    if ((0.0 != g_mutexRelease) && ((next < 0.0) || (g_mutexRelease - now < next)))
+        next = g_mutexRelease - now;
+
+    return (next);
+}
+
+/* Serve one request on the client socket; returns -1 if it was closed. */
+static int RobotSim_serve( modbus_t * ctx, int socket )
+{
+    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+    int length;
+    int function;
+
+    modbus_set_socket(ctx, socket);
+
+    length = modbus_receive(ctx, query);
+    if (length <= 0) return (-1);
+
+    function = query[modbus_get_header_length(ctx)];
+    if (function < ROBOT_SIM_N_FUNCTIONS)
+        g_stats.nRequests[function]++;
+
+    if (RobotSim_chance(g_config.dropRate))
+    {
+        g_stats.nDropped++;
+        return (-1);
+    }
+
+    if (g_config.latencyUs)
+        usleep(g_config.latencyUs);
+
+    if (RobotSim_chance(g_config.exceptionRate))
+    {
+        g_stats.nExceptions++;
+        modbus_reply_exception( ctx,
+                                query,
+                                MODBUS_EXCEPTION_SLAVE_OR_SERVER_FAILURE );
+        return (0);
+    }
+
+    modbus_reply(ctx, query, length, g_map);
+
+    return (0);
+}
+
+static void RobotSim_printStats( void )
+{
+    unsigned long nRequests = 0;
+    unsigned long nCompleted = 0;
+    int i;
+
+    fprintf(stderr, "RobotSim: %lu connections\n", g_stats.nConnections);
+    for (i = 0; i < ROBOT_SIM_N_FUNCTIONS; i++)
+    {
+        if (!g_stats.nRequests[i]) continue;
+        fprintf(stderr, "    FC%-2d       %8lu requests\n", i, g_stats.nRequests[i]);
+        nRequests += g_stats.nRequests[i];
+    }
+    for (i = 1; i < ROBOT_SIM_N_COMMANDS; i++)
+    {
+        if (!g_stats.nCompleted[i]) continue;
+        fprintf(stderr, "    %-10s %8lu completed\n", g_commandNames[i], g_stats.nCompleted[i]);
+        nCompleted += g_stats.nCompleted[i];
+    }
+    fprintf(stderr, "    %lu exceptions, %lu dropped, %lu aborted\n",
+            g_stats.nExceptions, g_stats.nDropped, g_stats.nAborted);
+    if (nCompleted)
+        fprintf(stderr, "    %.1f requests per command\n",
+                (double) nRequests / nCompleted);
+}
+
+static void RobotSim_usage( const char * name )
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "    -a address      listen address (default %s)\n"
+            "    -p port         listen port (default %s)\n"
+            "    -t command=ms   motion time for one command, e.g. flip=4000\n"
+            "    -T scale        multiply all motion times (0 = instant)\n"
+            "    -l us           reply latency\n"
+            "    -x rate         probability of an exception reply\n"
+            "    -d rate         probability of dropping the connection\n"
+            "    -m ms           hold the mutex this long after each motion\n"
+            "    -n              stock robot program: no sequence echo, no sweep\n"
+            "    -s seed         random seed for fault injection\n"
+            "    -v              log each motion\n",
+            name, ROBOT_SIM_DEFAULT_ADDRESS, ROBOT_SIM_DEFAULT_PORT);
+}
+
+static int RobotSim_parseDuration( const char * arg )
+{
+    const char * equals = strchr(arg, '=');
+    int i;
+
+    if (NULL == equals) return (-1);
+
+    for (i = 1; i < ROBOT_SIM_N_COMMANDS; i++)
+    {
+        if (    (strlen(g_commandNames[i]) == (size_t) (equals - arg))
+            &&  (0 == strncmp(g_commandNames[i], arg, equals - arg))    )
+        {
+            g_config.durationMs[i] = atof(equals + 1);
+            return (0);
+        }
+    }
+
+    return (-1);
+}
+
+int main( int argc, char ** argv )
+{
+    int         clients[ROBOT_SIM_MAX_CLIENTS];
+    int         nClients = 0;
+    modbus_t *  ctx;
+    int         server;
+    int         option;
+    long        seed = 1;
+    int         i;
+
+    g_config.address        = ROBOT_SIM_DEFAULT_ADDRESS;
+    g_config.port           = ROBOT_SIM_DEFAULT_PORT;
+    g_config.timeScale      = 1.0;
+    g_config.durationMs[RCTL_COMMAND_HOME]      = 1500.0;
+    g_config.durationMs[RCTL_COMMAND_PHOTO]     = 1500.0;
+    g_config.durationMs[RCTL_COMMAND_HERE]      = 2000.0;
+    g_config.durationMs[RCTL_COMMAND_TEMP]      = 2500.0;
+    g_config.durationMs[RCTL_COMMAND_FLIP]      = 4000.0;
+    g_config.durationMs[RCTL_COMMAND_DEPOSIT]   = 4000.0;
+    g_config.durationMs[RCTL_COMMAND_SWEEP]     = 1000.0;   /* per leg */
+
+    while (-1 != (option = getopt(argc, argv, "a:p:t:T:l:x:d:m:ns:vh")))
+    {
+        switch (option)
+        {
+            case 'a': g_config.address          = optarg;                   break;
+            case 'p': g_config.port             = optarg;                   break;
+            case 'T': g_config.timeScale        = atof(optarg);             break;
+            case 'l': g_config.latencyUs        = strtoul(optarg, NULL, 0); break;
+            case 'x': g_config.exceptionRate    = atof(optarg);             break;
+            case 'd': g_config.dropRate         = atof(optarg);             break;
+            case 'm': g_config.mutexHoldMs      = atof(optarg);             break;
+            case 'n': g_config.noSequence       = 1;                        break;
+            case 's': seed                      = strtol(optarg, NULL, 0);  break;
+            case 'v': g_config.verbose          = 1;                        break;
+            case 't':
+                if (0 == RobotSim_parseDuration(optarg)) break;
+                fprintf(stderr, "RobotSim: bad duration '%s'.\n", optarg);
+                /* fall through */
+            default:
+                RobotSim_usage(argv[0]);
+                return (EXIT_FAILURE);
+        }
+    }
+
+    srand48(seed);
+    signal(SIGINT, RobotSim_onSignal);
+    signal(SIGTERM, RobotSim_onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    ctx = modbus_new_tcp_pi(g_config.address, g_config.port);
+    g_map = modbus_mapping_new(0, 0, ROBOT_SIM_N_REGISTERS, 0);
+    if ((NULL == ctx) || (NULL == g_map))
+    {
+        fprintf(stderr, "RobotSim: could not allocate the server.\n");
+        return (EXIT_FAILURE);
+    }
+    RobotSim_setPose(RCTL_ADDRESS_CURRENT_POSE, &g_homePose);
+
+    server = modbus_tcp_pi_listen(ctx, ROBOT_SIM_MAX_CLIENTS);
+    if (-1 == server)
+    {
+        fprintf(stderr, "RobotSim: cannot listen on %s:%s: %s\n",
+                g_config.address, g_config.port, modbus_strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    fprintf(stderr, "RobotSim: listening on %s:%s\n", g_config.address, g_config.port);
+
+    while (!g_quit)
+    {
+        struct timeval timeout;
+        struct timeval * pTimeout = NULL;
+        fd_set readable;
+        int fdMax = server;
+        double wait;
+        int nReady;
+
+        wait = RobotSim_step(RobotSim_now());
+        if (wait >= 0.0)
+        {
+            timeout.tv_sec  = (time_t) wait;
+            timeout.tv_usec = (suseconds_t) ((wait - timeout.tv_sec) * 1e6);
+            pTimeout = &timeout;
+        }
+
+        FD_ZERO(&readable);
+        FD_SET(server, &readable);
+        for (i = 0; i < nClients; i++)
+        {
+            FD_SET(clients[i], &readable);
+            if (clients[i] > fdMax) fdMax = clients[i];
+        }
+
+        nReady = select(fdMax + 1, &readable, NULL, NULL, pTimeout);
+        if (nReady <= 0) continue;
+
+        if (FD_ISSET(server, &readable))
+        {
+            int client = accept(server, NULL, NULL);
+
+            if ((-1 != client) && (nClients < ROBOT_SIM_MAX_CLIENTS))
+            {
+                clients[nClients++] = client;
+                g_stats.nConnections++;
+            }
+            else if (-1 != client)
+            {
+                close(client);
+            }
+        }
+
+        for (i = 0; i < nClients; i++)
+        {
+            if (!FD_ISSET(clients[i], &readable)) continue;
+
+            /* let the robot react to each write before the next request */
+            RobotSim_step(RobotSim_now());
+
+            if (-1 == RobotSim_serve(ctx, clients[i]))
+            {
+                close(clients[i]);
+                clients[i--] = clients[--nClients];
+            }
+        }
+    }
+
+    RobotSim_printStats();
+
+    for (i = 0; i < nClients; i++)
+        close(clients[i]);
+    close(server);
+    modbus_mapping_free(g_map);
+    modbus_free(ctx);
+
+    return (EXIT_SUCCESS);
+}
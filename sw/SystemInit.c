@@ -0,0 +1,149 @@
+
+/*
+File:   SystemInit.c
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file implements the init orchestrator.  None of the subsystems below
+depend on each other: the hotplate, conveyor and button pins are distinct
+lines, the temperature sensor is on the I2C bus, and the robot and camera
+are separate devices.  They are therefore all started at once, and the
+total startup time is that of the slowest one.
+
+What they do share is locked: the gpio value descriptor cache and the i2c
+bus cache each have a mutex, and DEBUG_PRINT writes every line with one
+call, so the threads' log lines do not interleave mid-line.
+*/
+
+#include "SystemInit.h"
+
+/* each init function gets its job's argument; only the robot's uses it,
+   as the place to store the robot's handle */
+static int SystemInit_hotplate  ( void * arg ) { (void) arg; return (Mezzanine_HotplateInit());   }
+static int SystemInit_conveyor  ( void * arg ) { (void) arg; return (Mezzanine_ConveyorInit());   }
+static int SystemInit_buttons   ( void * arg ) { (void) arg; return (Mezzanine_ButtonsInit());    }
+static int SystemInit_tempSensor( void * arg ) { (void) arg; return (Mezzanine_TempSensorInit()); }
+static int SystemInit_camera    ( void * arg ) { (void) arg; return (PattyFactory_init());        }
+
+static int SystemInit_robot( void * arg )
+{
+    struct ROBOT_CONTROL ** robot = arg;
+
+    /* endpoint from the environment, or the default */
+    *robot = RobotControl_Init(NULL, NULL);
+
+    return ((NULL == *robot) ? RCTL_E_MODBUS_CONNECT : 0);
+}
+
+static int (* const g_initFunctions[SYSINIT_COUNT])( void * arg ) =
+{
+    [SYSINIT_HOTPLATE]      = SystemInit_hotplate,
+    [SYSINIT_CONVEYOR]      = SystemInit_conveyor,
+    [SYSINIT_BUTTONS]       = SystemInit_buttons,
+    [SYSINIT_TEMP_SENSOR]   = SystemInit_tempSensor,
+    [SYSINIT_ROBOT]         = SystemInit_robot,
+    [SYSINIT_CAMERA]        = SystemInit_camera
+};
+
+static const char * const g_names[SYSINIT_COUNT] =
+{
+    [SYSINIT_HOTPLATE]      = "hotplate",
+    [SYSINIT_CONVEYOR]      = "conveyor",
+    [SYSINIT_BUTTONS]       = "buttons",
+    [SYSINIT_TEMP_SENSOR]   = "temperature sensor",
+    [SYSINIT_ROBOT]         = "robot",
+    [SYSINIT_CAMERA]        = "camera"
+};
+
+static double SystemInit_seconds( void )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec + now.tv_nsec * 1e-9);
+}
+
+struct SYSTEM_INIT_JOB
+{
+    int                         subsystem;
+    void *                      arg;
+    struct SYSTEM_INIT_REPORT * report;
+};
+
+static void * SystemInit_thread( void * _job )
+{
+    struct SYSTEM_INIT_JOB * job = _job;
+    double start;
+
+    start = SystemInit_seconds();
+    job->report->result  = g_initFunctions[job->subsystem](job->arg);
+    job->report->seconds = SystemInit_seconds() - start;
+
+    return (NULL);
+}
+
+int SystemInit_All(    struct SYSTEM_INIT_REPORT * report,
+                        struct ROBOT_CONTROL **     robot   )
+{
+    struct SYSTEM_INIT_JOB  jobs[SYSINIT_COUNT];
+    pthread_t               threads[SYSINIT_COUNT];
+    int                     started[SYSINIT_COUNT];
+    int                     nFailed = 0;
+    int                     i;
+
+    DEBUG_PRINT_LEVEL(G_SYSTEM_LOG, "Initializing subsystems concurrently.\n");
+
+    *robot = NULL;
+
+    for (i = 0; i < SYSINIT_COUNT; i++)
+    {
+        report[i].name      = g_names[i];
+        report[i].result    = 0;
+        report[i].seconds   = 0.0;
+
+        jobs[i].subsystem   = i;
+        jobs[i].arg         = (SYSINIT_ROBOT == i) ? robot : NULL;
+        jobs[i].report      = &report[i];
+
+        started[i] = (0 == pthread_create(  &threads[i], NULL,
+                                            SystemInit_thread, &jobs[i] ));
+
+        /* no thread to spare: do it here */
+        if (!started[i]) SystemInit_thread(&jobs[i]);
+    }
+
+    for (i = 0; i < SYSINIT_COUNT; i++)
+    {
+        if (started[i]) pthread_join(threads[i], NULL);
+        if (0 != report[i].result) nFailed++;
+    }
+
+    return (nFailed);
+}
+
+void SystemInit_PrintReport(    FILE *                      fptr,
+                                struct SYSTEM_INIT_REPORT * report  )
+{
+    double slowest = 0.0;
+    int i;
+
+    DEBUG_PRINT_LEVEL(fptr, "Subsystem init times:\n");
+    DEBUG_PRINT_LEVEL_ENTER();
+
+    for (i = 0; i < SYSINIT_COUNT; i++)
+    {
+        DEBUG_PRINT_LEVEL(fptr, "");
+        fprintf(fptr, "%-20s %8.3f s  (%d)\n",
+                report[i].name, report[i].seconds, report[i].result);
+
+        if (report[i].seconds > slowest) slowest = report[i].seconds;
+    }
+
+    DEBUG_PRINT_LEVEL(fptr, "");
+    fprintf(fptr, "%-20s %8.3f s\n", "ready after", slowest);
+
+    DEBUG_PRINT_LEVEL_EXIT();
+    fflush(fptr);
+}
@@ -0,0 +1,55 @@
+
+#ifndef SYSTEMINIT_H
+#define SYSTEMINIT_H
+
+/*
+File:   SystemInit.h
+Date:   2019-05-14
+Author: Peter Lapets
+
+Description:
+This file declares an init orchestrator which brings up the mezzanine
+hardware, the robot connection and the camera concurrently.  Each
+subsystem is initialized on its own thread, and the time each took is
+recorded in a report.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "DEBUG_PRINT.h"
+
+#include "Mezzanine/Mezzanine.h"
+#include "RobotControl/RobotControl.h"
+#include "RecipeScheduling/PattyFactory.hpp"
+
+enum SYSTEM_INIT_SUBSYSTEM
+{
+    SYSINIT_HOTPLATE,
+    SYSINIT_CONVEYOR,
+    SYSINIT_BUTTONS,
+    SYSINIT_TEMP_SENSOR,
+    SYSINIT_ROBOT,
+    SYSINIT_CAMERA,
+    SYSINIT_COUNT
+};
+
+struct SYSTEM_INIT_REPORT
+{
+    const char *    name;
+    int             result;     /* subsystem's return value, 0 if ok    */
+    double          seconds;    /* wall time spent in its init function */
+};
+
+/*  SystemInit_All( report, robot )
+ *  Initializes all subsystems and fills in report[SYSINIT_COUNT].  The
+ *  robot's handle is stored in *robot (NULL if it could not be reached).
+ *  Returns the number of subsystems which reported an error or warning.
+ */
+int     SystemInit_All          (   struct SYSTEM_INIT_REPORT * report,
+                                    struct ROBOT_CONTROL **     robot   );
+void    SystemInit_PrintReport  (   FILE *                      fptr,
+                                    struct SYSTEM_INIT_REPORT * report  );
+
+#endif /* SYSTEMINIT_H */